@@ -27,8 +27,8 @@ byte charNumberToByte(char c) {
   return 0;
 }  
 
-byte charArrayToByte(uint8_t* arr , unsigned int length) {
-  byte result = 0;
+unsigned long charArrayToULong(uint8_t* arr , unsigned int length) {
+  unsigned long result = 0;
   for (int i = 0; i < length; i++) {
     result *= 10;
     result += charNumberToByte(arr[i]);
@@ -36,22 +36,353 @@ byte charArrayToByte(uint8_t* arr , unsigned int length) {
   return result;
 }
 
+unsigned int charArrayToUInt(uint8_t* arr , unsigned int length) {
+  return (unsigned int)charArrayToULong(arr, length);
+}
+
+byte charArrayToByte(uint8_t* arr , unsigned int length) {
+  return (byte)charArrayToUInt(arr, length);
+}
+
+/*
+  Trace ids, optional, appended to the payload as "<value>;<trace id>".
+  A traced color is sent as {'T', id high, id low, color, value},
+  the controller answers with {'T', id high, id low, us high, us low}
+  where us is the time from reading the frame to writing the LED.
+*/
+#define TRACE_SEPARATOR ';'
+#define TRACE_FRAME 'T'
+
+/*
+  Scheduler sync, LED/sync with the show time in ms as payload
+  is sent as {'S', time bytes, most significant first},
+  LED/RGB as {'C', red, green, blue}
+*/
+#define SYNC_TOPIC "sync"
+#define SYNC_FRAME 'S'
+#define RGB_FRAME 'C'
+
+/*
+  Batched colors from the effect engine, LED/frame with
+  records of {address, mask, values} as payload, mask bits
+  as PENDING_R, G and B with a value byte for each set bit
+*/
+#define FRAME_TOPIC "frame"
+
+/*
+  Device addressing, one UART bus shared by several controllers
+    LED/<channel>          all controllers
+    LED/all/<channel>      all controllers
+    LED/<id>/<channel>     controller id (1 <=> 127)
+    LED/g<n>/<channel>     controllers in group n (0 <=> 7)
+  where channel is R, G, B, RGB ("<r>,<g>,<b>") or sync.
+  Frames to an address other than all are
+  prefixed with {'A', address}.
+*/
+#define ADDRESS_FRAME 'A'
+#define BROADCAST_ADDRESS 0
+#define MAX_BUS_ADDRESS 127
+#define GROUP_ADDRESS 0x80
+#define NO_ADDRESS 0xFF
+
+/*
+  Messages are queued per address and sent round-robin,
+  one frame per device in turn, so a busy controller can't starve
+  the others. A newer value for a channel replaces
+  the queued one.
+  A queued value is held back while an older value for the same
+  channel is queued for an address that can reach the same
+  controllers (broadcast, groups), so controllers end up with the
+  newest one. With all MAX_DEVICES queues in use, messages to
+  other addresses are dropped and counted.
+*/
+#define MAX_DEVICES 16
+#define MQTT_READS_PER_LOOP 4  // messages taken per loop
+#define FRAMES_PER_LOOP 4      // frames sent per loop
+#define PENDING_R 0x01
+#define PENDING_G 0x02
+#define PENDING_B 0x04
+#define PENDING_RGB 0x07
+#define PENDING_SYNC 0x08
+#define PENDING_CHANNELS 4
+
+struct DeviceQueue {
+  byte address;
+  byte pending;                 // PENDING_ bits, 0 when slot is free
+  byte color[3];
+  unsigned int trace;           // trace of a pending color, 0 for none
+  byte trace_color;
+  unsigned long trace_received; // micros() when the traced message came in
+  unsigned long sync_time;
+  unsigned int sequence[PENDING_CHANNELS]; // order each pending channel was queued in
+};
+
+DeviceQueue devices[MAX_DEVICES];
+byte next_device = 0;
+unsigned int next_sequence = 0;
+unsigned int queue_drops = 0;   // messages dropped with every slot in use
+
+/*
+  Queue for address, a free slot if none, NULL if all are in use
+*/
+DeviceQueue* deviceQueue(byte address) {
+  DeviceQueue *free_queue = NULL;
+  for (int i = 0; i < MAX_DEVICES; i++) {
+    if (devices[i].pending == 0) {
+      if (!free_queue) free_queue = &devices[i];
+    }
+    else if (devices[i].address == address) return &devices[i];
+  }
+  if (free_queue) {
+    free_queue->address = address;
+    free_queue->trace = 0;
+  }
+  else {
+    queue_drops++;
+    Serial.print(F("Queues full, dropped "));
+    Serial.println(queue_drops);
+  }
+  return free_queue;
+}
+
+/*
+  Set channels pending, in the order they are queued
+*/
+void setPending(DeviceQueue *device, byte channels) {
+  next_sequence++;
+  for (byte i = 0; i < PENDING_CHANNELS; i++) {
+    if (channels & (1 << i)) device->sequence[i] = next_sequence;
+  }
+  device->pending |= channels;
+}
+
+/*
+  True if frames to a and b can reach the same controller,
+  group members are only known to the controllers
+*/
+bool overlaps(byte a, byte b) {
+  if (a == BROADCAST_ADDRESS || b == BROADCAST_ADDRESS) return true;
+  return (a & GROUP_ADDRESS) || (b & GROUP_ADDRESS);
+}
+
+/*
+  Pending channels of device that can be sent, those with
+  no older value queued for an overlapping address
+*/
+byte sendablePending(DeviceQueue *device) {
+  byte sendable = device->pending;
+  for (int n = 0; n < MAX_DEVICES; n++) {
+    DeviceQueue *other = &devices[n];
+    if (other == device || !(other->pending & sendable) || !overlaps(device->address, other->address)) continue;
+    for (byte i = 0; i < PENDING_CHANNELS; i++) {
+      byte bit = 1 << i;
+      // wrap safe, sequences of queued values are close together
+      if ((other->pending & bit) && (int)(other->sequence[i] - device->sequence[i]) < 0) sendable &= ~bit;
+    }
+  }
+  return sendable;
+}
+
+/*
+  Address from the topic segment after LED/,
+  NO_ADDRESS if not an address
+*/
+byte parseAddress(const char* segment, unsigned int length) {
+  if (length == 3 && strncmp(segment, "all", 3) == 0) return BROADCAST_ADDRESS;
+  if (length == 2 && segment[0] == 'g' && segment[1] >= '0' && segment[1] <= '7') return GROUP_ADDRESS | (segment[1] - '0');
+  if (length == 0 || length > 3) return NO_ADDRESS;
+  for (unsigned int i = 0; i < length; i++) {
+    if (segment[i] < '0' || segment[i] > '9') return NO_ADDRESS;
+  }
+  unsigned int id = charArrayToUInt((uint8_t*)segment, length);
+  if (id == 0 || id > MAX_BUS_ADDRESS) return NO_ADDRESS;
+  return id;
+}
+
+/*
+  Channel index (0 R, 1 G, 2 B) from the topic, -1 if not a color
+*/
+int colorIndex(const char* channel) {
+  if (strlen(channel) != 1) return -1;
+  switch (channel[0]) {
+    case 'R': return 0;
+    case 'G': return 1;
+    case 'B': return 2;
+  }
+  return -1;
+}
+
+/*
+  Publish hop timestamps, "<trace id> <a> <b>"
+*/
+void publishTrace(const char* topic, unsigned int trace, unsigned long a, unsigned long b) {
+  char out[32];
+  snprintf(out, sizeof(out), "%u %lu %lu", trace, a, b);
+  mqtt_client.publish(topic, out);
+}
+
+/*
+  Writes a frame, prefixed with the address unless broadcast
+*/
+void sendFrame(byte address, byte* frame, byte length) {
+  if (address != BROADCAST_ADDRESS) {
+    byte header[] = {ADDRESS_FRAME, address};
+    SerialOut.write(header, 2);
+  }
+  SerialOut.write(frame, length);
+}
+
+/*
+  Send one frame from the next device with something queued,
+  false if nothing is queued
+*/
+bool sendQueued() {
+  for (int n = 0; n < MAX_DEVICES; n++) {
+    DeviceQueue *device = &devices[next_device];
+    next_device = (next_device + 1) % MAX_DEVICES;
+    if (device->pending == 0) continue;
+    byte sendable = sendablePending(device);
+    if (sendable == 0) continue;
+
+    if (sendable & PENDING_SYNC) {
+      unsigned long t = device->sync_time;
+      byte frame[] = {SYNC_FRAME, (byte)(t >> 24), (byte)(t >> 16), (byte)(t >> 8), (byte)t};
+      sendFrame(device->address, frame, 5);
+      device->pending &= ~PENDING_SYNC;
+    }
+    else if ((sendable & PENDING_RGB) == PENDING_RGB && device->trace == 0) {
+      byte frame[] = {RGB_FRAME, device->color[0], device->color[1], device->color[2]};
+      sendFrame(device->address, frame, 4);
+      device->pending &= ~PENDING_RGB;
+    }
+    else {
+      byte i = 0;
+      while (!(sendable & (1 << i))) i++;
+      const char colors[] = "RGB";
+      if (device->trace != 0 && device->trace_color == i) {
+        byte frame[] = {TRACE_FRAME, (byte)(device->trace >> 8), (byte)device->trace, (byte)colors[i], device->color[i]};
+        sendFrame(device->address, frame, 5);
+        publishTrace("trace/gw", device->trace, device->trace_received, micros());
+        device->trace = 0;
+      }
+      else {
+        byte frame[] = {(byte)colors[i], device->color[i]};
+        sendFrame(device->address, frame, 2);
+      }
+      device->pending &= ~(1 << i);
+    }
+    return true;
+  }
+  return false;
+}
+
+/*
+  Queue a color value, "<value>[;<trace id>]"
+*/
+void queueColor(byte address, int color, uint8_t* payload, unsigned int length, unsigned long received) {
+  unsigned int value_length = 0;
+  while (value_length < length && payload[value_length] != TRACE_SEPARATOR) value_length++;
+  byte value = charArrayToByte(payload, value_length); 
+  unsigned int trace = 0;
+  if (value_length + 1 < length) trace = charArrayToUInt(payload + value_length + 1, length - value_length - 1);
+
+  DeviceQueue *device = deviceQueue(address);
+  if (!device) return;
+  device->color[color] = value;
+  setPending(device, 1 << color);
+  if (trace != 0) {
+    device->trace = trace;
+    device->trace_color = color;
+    device->trace_received = received;
+  }
+  else if (device->trace_color == color) device->trace = 0;
+}
+
+/*
+  Queue all three colors, "<r>,<g>,<b>"
+*/
+void queueRGB(byte address, uint8_t* payload, unsigned int length) {
+  byte rgb[3];
+  unsigned int start = 0;
+  for (int i = 0; i < 3; i++) {
+    unsigned int end = start;
+    while (end < length && payload[end] != ',') end++;
+    if (end == start) return;
+    rgb[i] = charArrayToByte(payload + start, end - start);
+    start = end + 1;
+  }
+  DeviceQueue *device = deviceQueue(address);
+  if (!device) return;
+  for (int i = 0; i < 3; i++) device->color[i] = rgb[i];
+  setPending(device, PENDING_RGB);
+  device->trace = 0;
+}
+
+/*
+  Queue a scheduler sync
+*/
+void queueSync(byte address, uint8_t* payload, unsigned int length) {
+  DeviceQueue *device = deviceQueue(address);
+  if (!device) return;
+  device->sync_time = charArrayToULong(payload, length);
+  setPending(device, PENDING_SYNC);
+}
+
+/*
+  Queue the records of a batched frame,
+  stops at a record that isn't complete or valid
+*/
+void queueFrame(uint8_t* payload, unsigned int length) {
+  unsigned int pos = 0;
+  while (pos + 2 <= length) {
+    byte address = payload[pos];
+    byte mask = payload[pos + 1];
+    pos += 2;
+    if (address > (GROUP_ADDRESS | 7)) return;
+    if (mask == 0 || (mask & ~PENDING_RGB)) return;
+    byte values = ((mask & PENDING_R) != 0) + ((mask & PENDING_G) != 0) + ((mask & PENDING_B) != 0);
+    if (pos + values > length) return;
+    DeviceQueue *device = deviceQueue(address);
+    for (byte i = 0; i < 3; i++) {
+      if (!(mask & (1 << i))) continue;
+      if (device) device->color[i] = payload[pos];
+      pos++;
+    }
+    if (!device) continue;
+    setPending(device, mask);
+    if (device->trace != 0 && (mask & (1 << device->trace_color))) device->trace = 0;
+  }
+}
+
 void onMQTTMessage(char* topic, uint8_t* payload, unsigned int length) {  
-    if (strlen(topic) > 4) {
-      byte value = charArrayToByte(payload, length); 
-      Serial.println(topic);
-      Serial.println(value);
-      Serial.write(payload, length);
-      byte data[] = {(byte)topic[4], value};
-      SerialOut.write(data, 2);
+    unsigned long received = micros();
+    if (strncmp(topic, "LED/", 4) != 0) return;
+    const char* channel = topic + 4;
+    byte address = BROADCAST_ADDRESS;
+    const char* slash = strchr(channel, '/');
+    if (slash) {
+      address = parseAddress(channel, slash - channel);
+      if (address == NO_ADDRESS) return;
+      channel = slash + 1;
+    }
+
+    Serial.println(topic);
+    if (strcmp(channel, FRAME_TOPIC) == 0) {
+      // binary, batched colors for many devices
+      if (!slash) queueFrame(payload, length);
+      return;
     }
+    Serial.write(payload, length);
+    Serial.println();
+    int color = colorIndex(channel);
+    if (color >= 0) queueColor(address, color, payload, length, received);
+    else if (strcmp(channel, "RGB") == 0) queueRGB(address, payload, length);
+    else if (strcmp(channel, SYNC_TOPIC) == 0) queueSync(address, payload, length);
 }
 void reconnect() {
     while (!mqtt_client.connected()) {
         if (mqtt_client.connect(F("ALeonardo"))) {
-            mqtt_client.subscribe(F("LED/R"));
-            mqtt_client.subscribe(F("LED/G"));
-            mqtt_client.subscribe(F("LED/B"));
+            mqtt_client.subscribe(F("LED/#"));
         } else {
           Serial.println(F("Failed to connect to server!"));
         }
@@ -59,11 +390,40 @@ void reconnect() {
     }
 } 
 
+/*
+  Publish a key event, "arduino/uno/key1" for the
+  controller without address, else "arduino/<id>/key1"
+*/
+void publishKey(byte address, byte key) {
+  if (address == BROADCAST_ADDRESS) {
+    mqtt_client.publish(F("arduino/uno/key1"), &key, 1);
+    return;
+  }
+  char topic[24];
+  snprintf(topic, sizeof(topic), "arduino/%u/key1", address);
+  mqtt_client.publish(topic, &key, 1);
+}
+
 void readSerial() {
   if (SerialOut.available()) {
     byte in[1];
     SerialOut.readBytes(in, 1);
-    mqtt_client.publish(F("arduino/uno/key1"), in);
+    if (in[0] == TRACE_FRAME) {
+      unsigned long received = micros();
+      byte report[4];
+      if (SerialOut.readBytes(report, 4) < 4) return;
+      unsigned int trace = (report[0] << 8) | report[1];
+      unsigned int led_time = (report[2] << 8) | report[3];
+      publishTrace("trace/ctl", trace, received, led_time);
+      return;
+    }
+    if (in[0] == ADDRESS_FRAME) {
+      byte event[2]; // address, key
+      if (SerialOut.readBytes(event, 2) < 2) return;
+      publishKey(event[0], event[1]);
+      return;
+    }
+    publishKey(BROADCAST_ADDRESS, in[0]);
   }
 }
 
@@ -80,6 +440,8 @@ void setup() {
 
 void loop() {
   if (!mqtt_client.connected()) reconnect();
-  mqtt_client.loop();
+  // take what has arrived before sending, newer values replace queued ones
+  for (int i = 0; i < MQTT_READS_PER_LOOP; i++) mqtt_client.loop();
+  for (int i = 0; i < FRAMES_PER_LOOP && sendQueued(); i++);
   readSerial();
 }
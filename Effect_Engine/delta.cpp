@@ -0,0 +1,84 @@
+#include "delta.hpp"
+
+#include <stdio.h>
+
+DeltaEncoder::DeltaEncoder(const std::vector<uint8_t> &addresses, int output, size_t max_payload)
+    : addresses(addresses), sent(addresses.size()), output(output), max_payload(max_payload) {
+    if (this->max_payload < RECORD_MAX) this->max_payload = RECORD_MAX;
+}
+
+std::string addressTopic(uint8_t address) {
+    char topic[16];
+    if (address == BROADCAST_ADDRESS) return "LED/";
+    if (address & GROUP_ADDRESS) snprintf(topic, sizeof(topic), "LED/g%u/", address & ~GROUP_ADDRESS);
+    else snprintf(topic, sizeof(topic), "LED/%u/", address);
+    return topic;
+}
+
+size_t DeltaEncoder::encode(const Frame &frame, bool keyframe, std::vector<Message> &messages) {
+    std::vector<uint8_t> masks(addresses.size());
+    size_t channels = 0;
+    for (size_t i = 0; i < addresses.size(); i++) {
+        const Color &now = frame[i];
+        const Color &last = sent[i];
+        uint8_t mask = MASK_RGB;
+        if (!keyframe && !first) {
+            mask = (now.r != last.r ? MASK_R : 0) | (now.g != last.g ? MASK_G : 0) | (now.b != last.b ? MASK_B : 0);
+        }
+        masks[i] = mask;
+        channels += (mask & MASK_R ? 1 : 0) + (mask & MASK_G ? 1 : 0) + (mask & MASK_B ? 1 : 0);
+    }
+    first = false;
+    sent = frame;
+    if (channels == 0) return 0;
+
+    if (output == OUTPUT_TOPICS) packTopics(frame, masks, messages);
+    else packFrame(frame, masks, messages);
+    return channels;
+}
+
+void DeltaEncoder::packFrame(const Frame &frame, const std::vector<uint8_t> &masks, std::vector<Message> &messages) {
+    std::string payload;
+    for (size_t i = 0; i < addresses.size(); i++) {
+        if (masks[i] == 0) continue;
+        char record[RECORD_MAX];
+        size_t length = 0;
+        record[length++] = addresses[i];
+        record[length++] = masks[i];
+        if (masks[i] & MASK_R) record[length++] = frame[i].r;
+        if (masks[i] & MASK_G) record[length++] = frame[i].g;
+        if (masks[i] & MASK_B) record[length++] = frame[i].b;
+        if (payload.size() + length > max_payload) {
+            messages.push_back({FRAME_TOPIC, payload});
+            payload.clear();
+        }
+        payload.append(record, length);
+    }
+    if (!payload.empty()) messages.push_back({FRAME_TOPIC, payload});
+}
+
+void DeltaEncoder::packTopics(const Frame &frame, const std::vector<uint8_t> &masks, std::vector<Message> &messages) {
+    char value[16];
+    for (size_t i = 0; i < addresses.size(); i++) {
+        std::string prefix = addressTopic(addresses[i]);
+        const Color &color = frame[i];
+        switch (masks[i]) {
+            case 0: continue;
+            case MASK_R:
+                snprintf(value, sizeof(value), "%u", color.r);
+                messages.push_back({prefix + "R", value});
+                break;
+            case MASK_G:
+                snprintf(value, sizeof(value), "%u", color.g);
+                messages.push_back({prefix + "G", value});
+                break;
+            case MASK_B:
+                snprintf(value, sizeof(value), "%u", color.b);
+                messages.push_back({prefix + "B", value});
+                break;
+            default:
+                snprintf(value, sizeof(value), "%u,%u,%u", color.r, color.g, color.b);
+                messages.push_back({prefix + "RGB", value});
+        }
+    }
+}
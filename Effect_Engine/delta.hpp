@@ -0,0 +1,68 @@
+#ifndef DELTA_HPP
+#define DELTA_HPP
+
+/*  Delta encoding of rendered frames into MQTT messages
+
+    Only channels that changed since the last frame are sent,
+    a keyframe sends all of them to bring back in step a
+    controller that missed an update or came up late.
+
+    OUTPUT_FRAME batches the changes of all fixtures into
+    LED/frame messages of {address, mask, values} records,
+    mask bits 0x01 red, 0x02 green and 0x04 blue, with one
+    value byte per set bit in that order. Records are never
+    split, a message holds at most max_payload bytes.
+
+    OUTPUT_TOPICS uses the per channel topics instead,
+    LED/<id>/R, G or B for a single changed channel and
+    LED/<id>/RGB for more, for gateways without LED/frame.
+*/
+
+#include "effects.hpp"
+
+#define FRAME_TOPIC "LED/frame"
+#define MASK_R 0x01
+#define MASK_G 0x02
+#define MASK_B 0x04
+#define MASK_RGB 0x07
+#define RECORD_MAX 5
+
+// Bus addresses, as on the gateway
+#define BROADCAST_ADDRESS 0
+#define MAX_BUS_ADDRESS 127
+#define GROUP_ADDRESS 0x80
+#define MAX_GROUP 7
+
+#define OUTPUT_FRAME 0
+#define OUTPUT_TOPICS 1
+
+struct Message {
+    std::string topic;
+    std::string payload;
+};
+
+class DeltaEncoder {
+private:
+    std::vector<uint8_t> addresses;
+    Frame sent;
+    int output;
+    size_t max_payload;
+    bool first = true;
+    void packFrame(const Frame &frame, const std::vector<uint8_t> &masks, std::vector<Message> &messages);
+    void packTopics(const Frame &frame, const std::vector<uint8_t> &masks, std::vector<Message> &messages);
+public:
+    DeltaEncoder(const std::vector<uint8_t> &addresses, int output, size_t max_payload);
+    /*
+        Append the messages for a frame, all channels for a keyframe,
+        returns the number of channels sent
+    */
+    size_t encode(const Frame &frame, bool keyframe, std::vector<Message> &messages);
+};
+
+/*
+    Topic prefix for an address, "LED/" for broadcast,
+    else "LED/<id>/" or "LED/g<n>/"
+*/
+std::string addressTopic(uint8_t address);
+
+#endif /* ifndef DELTA_HPP */
@@ -0,0 +1,99 @@
+#include "effects.hpp"
+
+#include <math.h>
+
+/*
+    Scale a color, level 0 <=> 1
+*/
+static Color scaled(Color color, float level) {
+    Color out = {(uint8_t)(color.r * level + 0.5f), (uint8_t)(color.g * level + 0.5f), (uint8_t)(color.b * level + 0.5f)};
+    return out;
+}
+
+/*
+    Fully saturated color for a hue, 0 <=> 1
+*/
+static Color hueColor(float hue) {
+    float h = (hue - floorf(hue)) * 6;
+    int sector = (int)h;
+    uint8_t rise = (uint8_t)((h - sector) * 255 + 0.5f);
+    uint8_t fall = 255 - rise;
+    switch (sector) {
+        case 0: return {255, rise, 0};
+        case 1: return {fall, 255, 0};
+        case 2: return {0, 255, rise};
+        case 3: return {0, fall, 255};
+        case 4: return {rise, 0, 255};
+        default: return {255, 0, fall};
+    }
+}
+
+class SolidEffect : public Effect {
+    Color color;
+public:
+    SolidEffect(const EffectOptions &options) : color(options.color) {}
+    void render(uint32_t show_time, Frame &frame) {
+        for (size_t i = 0; i < frame.size(); i++) frame[i] = color;
+    }
+};
+
+/*
+    Hue cycling once per period, offset along the fixtures
+*/
+class RainbowEffect : public Effect {
+    uint32_t period;
+    float spread;
+public:
+    RainbowEffect(const EffectOptions &options) : period(options.period), spread(options.spread) {}
+    void render(uint32_t show_time, Frame &frame) {
+        float hue = (float)(show_time % period) / period;
+        for (size_t i = 0; i < frame.size(); i++) {
+            frame[i] = hueColor(hue + spread * i / frame.size());
+        }
+    }
+};
+
+/*
+    One lit fixture moving along the fixtures once per period,
+    the one it left fading out behind it
+*/
+class ChaseEffect : public Effect {
+    Color color;
+    uint32_t period;
+public:
+    ChaseEffect(const EffectOptions &options) : color(options.color), period(options.period) {}
+    void render(uint32_t show_time, Frame &frame) {
+        size_t count = frame.size();
+        float position = (float)(show_time % period) / period * count;
+        size_t lit = (size_t)position % count;
+        size_t trail = (lit + count - 1) % count;
+        for (size_t i = 0; i < count; i++) frame[i] = scaled(color, 0);
+        if (count > 1) frame[trail] = scaled(color, 1 - (position - floorf(position)));
+        frame[lit] = color;
+    }
+};
+
+/*
+    Flash on every beat, fading out over decay beats
+*/
+class PulseEffect : public Effect {
+    Color color;
+    float beat_ms;
+    float decay;
+public:
+    PulseEffect(const EffectOptions &options) : color(options.color), beat_ms(60000.0f / options.bpm), decay(options.decay) {}
+    void render(uint32_t show_time, Frame &frame) {
+        float phase = fmodf(show_time / beat_ms, 1.0f);
+        float level = phase < decay ? 1 - phase / decay : 0;
+        Color out = scaled(color, level * level);
+        for (size_t i = 0; i < frame.size(); i++) frame[i] = out;
+    }
+};
+
+Effect *makeEffect(const std::string &name, const EffectOptions &options) {
+    if (name == "solid") return new SolidEffect(options);
+    if (name == "rainbow") return new RainbowEffect(options);
+    if (name == "chase") return new ChaseEffect(options);
+    if (name == "pulse") return new PulseEffect(options);
+    return NULL;
+}
@@ -0,0 +1,43 @@
+#ifndef EFFECTS_HPP
+#define EFFECTS_HPP
+
+/*  Effects rendered by the effect engine
+
+    An effect fills a frame, one RGB color per fixture,
+    for a show time in ms. Effects are pure functions of
+    the show time, so a frame can be rendered for any time
+    without the ones before it, and offline renders match
+    the live ones.
+*/
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct Color {
+    uint8_t r, g, b;
+};
+
+typedef std::vector<Color> Frame;
+
+class Effect {
+public:
+    virtual ~Effect() {}
+    virtual void render(uint32_t show_time, Frame &frame) = 0;
+};
+
+struct EffectOptions {
+    Color color = {255, 0, 0};
+    uint32_t period = 2000;   // ms, one rainbow cycle or chase lap
+    float bpm = 120;          // pulse beats per minute
+    float decay = 0.25f;      // pulse fade time as a part of a beat
+    float spread = 1.0f;      // rainbow hue spread over all fixtures, in cycles
+};
+
+/*
+    Effect by name: solid, rainbow, chase or pulse,
+    NULL for an unknown name
+*/
+Effect *makeEffect(const std::string &name, const EffectOptions &options);
+
+#endif /* ifndef EFFECTS_HPP */
@@ -0,0 +1,336 @@
+/*  Effect engine
+
+    Renders an effect for a set of fixtures (controller bus
+    addresses) at a fixed tick, delta encodes the frames and
+    publishes them to the gateway (see delta.hpp), or writes
+    them to a file to benchmark offline.
+
+    Ticks are paced on absolute deadlines of the monotonic
+    clock, so wake-up latency doesn't add up into drift.
+    A tick that is late by a whole tick is skipped rather than
+    sent in a burst. Stats go to stderr on exit.
+
+    build, in Effect_Engine: g++ -std=c++11 -O2 -o effect_engine *.cpp
+*/
+
+#include "delta.hpp"
+#include "effects.hpp"
+#include "sink.hpp"
+
+#include <algorithm>
+#include <errno.h>
+#include <getopt.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#define SYNC_TOPIC "LED/sync"
+#define RECONNECT_NS 1000000000ULL
+
+static volatile sig_atomic_t running = 1;
+
+static void onSignal(int signal) {
+    running = 0;
+}
+
+static void usage() {
+    fprintf(stderr,
+        "usage: effect_engine [options]\n"
+        "  --effect NAME       solid, rainbow, chase or pulse (rainbow)\n"
+        "  --fixtures LIST     addresses: all, <id>, <first>-<last>, g<n>, comma separated (all)\n"
+        "  --tick MS           frame period (40)\n"
+        "  --duration S        stop after S seconds of show time, 0 runs until stopped (0)\n"
+        "  --keyframe MS       send every channel this often, 0 only at start (2000)\n"
+        "  --output MODE       frame (LED/frame batches) or topics (LED/<id>/<channel>) (frame)\n"
+        "  --max-payload N     bytes per LED/frame message (200)\n"
+        "  --broker HOST       (OELC_MQTT_HOST or 127.0.0.1)\n"
+        "  --port PORT         (OELC_MQTT_PORT or 1883)\n"
+        "  --file PATH         write messages to PATH instead of the broker\n"
+        "  --offline           render as fast as possible, for --file benchmarks\n"
+        "  --sync              publish the show time on LED/sync with each keyframe\n"
+        "  --realtime          SCHED_FIFO and locked memory, needs root\n"
+        "  --color R,G,B       solid, chase and pulse color (255,0,0)\n"
+        "  --period MS         rainbow cycle or chase lap (2000)\n"
+        "  --bpm N             pulse beats per minute (120)\n"
+        "  --decay F           pulse fade as a part of a beat (0.25)\n"
+        "  --spread F          rainbow hue cycles over the fixtures (1)\n");
+}
+
+/*
+    Parse a fixture list, false if it isn't one
+*/
+static bool parseFixtures(const char *list, std::vector<uint8_t> &addresses) {
+    std::string items(list);
+    size_t start = 0;
+    while (start <= items.size()) {
+        size_t end = items.find(',', start);
+        if (end == std::string::npos) end = items.size();
+        std::string item = items.substr(start, end - start);
+        start = end + 1;
+        unsigned int first, last, group;
+        char extra;
+        if (item == "all") addresses.push_back(BROADCAST_ADDRESS);
+        else if (sscanf(item.c_str(), "g%u%c", &group, &extra) == 1 && group <= MAX_GROUP) {
+            addresses.push_back(GROUP_ADDRESS | group);
+        }
+        else if (sscanf(item.c_str(), "%u-%u%c", &first, &last, &extra) == 2
+                && first >= 1 && first <= last && last <= MAX_BUS_ADDRESS) {
+            for (unsigned int id = first; id <= last; id++) addresses.push_back(id);
+        }
+        else if (sscanf(item.c_str(), "%u%c", &first, &extra) == 1 && first <= MAX_BUS_ADDRESS) {
+            addresses.push_back(first);
+        }
+        else return false;
+    }
+    return !addresses.empty();
+}
+
+static bool parseColor(const char *text, Color &color) {
+    unsigned int r, g, b;
+    char extra;
+    if (sscanf(text, "%u,%u,%u%c", &r, &g, &b, &extra) != 3 || r > 255 || g > 255 || b > 255) return false;
+    color = {(uint8_t)r, (uint8_t)g, (uint8_t)b};
+    return true;
+}
+
+static void sleepUntil(uint64_t deadline) {
+    struct timespec at = {(time_t)(deadline / 1000000000ULL), (long)(deadline % 1000000000ULL)};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &at, NULL) == EINTR && running);
+}
+
+/*
+    Histogram of ns times, fixed size so the tick loop never allocates,
+    HISTOGRAM_SUB buckets per power of two (within about 3%), exact max
+*/
+#define HISTOGRAM_BITS 5
+#define HISTOGRAM_SUB (1 << HISTOGRAM_BITS)
+#define HISTOGRAM_BUCKETS ((32 - HISTOGRAM_BITS + 1) * HISTOGRAM_SUB)
+
+struct TimeHistogram {
+    uint64_t counts[HISTOGRAM_BUCKETS] = {};
+    uint64_t total = 0;
+    uint32_t max = 0;
+
+    void add(uint64_t ns) {
+        uint32_t value = ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns;
+        size_t bucket = value;
+        if (value >= HISTOGRAM_SUB) {
+            int shift = 31 - __builtin_clz(value) - HISTOGRAM_BITS;
+            bucket = (shift + 1) * HISTOGRAM_SUB + (value >> shift) - HISTOGRAM_SUB;
+        }
+        counts[bucket]++;
+        total++;
+        if (value > max) max = value;
+    }
+
+    // middle of the bucket holding the p quantile, in us
+    double percentile(double p) const {
+        if (total == 0) return 0;
+        if (p >= 1.0) return max / 1000.0;
+        uint64_t rank = (uint64_t)(p * total), seen = 0;
+        for (size_t bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+            seen += counts[bucket];
+            if (seen <= rank) continue;
+            if (bucket < HISTOGRAM_SUB) return bucket / 1000.0;
+            int shift = bucket / HISTOGRAM_SUB - 1;
+            double low = (double)((uint64_t)(HISTOGRAM_SUB + bucket % HISTOGRAM_SUB) << shift);
+            return std::min(low + ((1ULL << shift) - 1) / 2.0, (double)max) / 1000.0;
+        }
+        return max / 1000.0;
+    }
+};
+
+static void printTimes(const char *name, const TimeHistogram &times) {
+    fprintf(stderr, "%-9s p50 %8.1f us  p99 %8.1f us  max %8.1f us\n", name,
+        times.percentile(0.5), times.percentile(0.99), times.percentile(1.0));
+}
+
+int main(int argc, char **argv) {
+    const char *effect_name = "rainbow";
+    const char *fixture_list = "all";
+    const char *broker = getenv("OELC_MQTT_HOST") ? getenv("OELC_MQTT_HOST") : "127.0.0.1";
+    uint16_t port = getenv("OELC_MQTT_PORT") ? atoi(getenv("OELC_MQTT_PORT")) : 1883;
+    const char *file_path = NULL;
+    uint32_t tick_ms = 40, keyframe_ms = 2000;
+    double duration = 0;
+    int output = OUTPUT_FRAME;
+    size_t max_payload = 200;
+    bool offline = false, sync = false, realtime = false;
+    EffectOptions options;
+
+    static const struct option long_options[] = {
+        {"effect", required_argument, NULL, 'e'},
+        {"fixtures", required_argument, NULL, 'f'},
+        {"tick", required_argument, NULL, 't'},
+        {"duration", required_argument, NULL, 'd'},
+        {"keyframe", required_argument, NULL, 'k'},
+        {"output", required_argument, NULL, 'o'},
+        {"max-payload", required_argument, NULL, 'm'},
+        {"broker", required_argument, NULL, 'h'},
+        {"port", required_argument, NULL, 'p'},
+        {"file", required_argument, NULL, 'w'},
+        {"offline", no_argument, NULL, 'x'},
+        {"sync", no_argument, NULL, 's'},
+        {"realtime", no_argument, NULL, 'r'},
+        {"color", required_argument, NULL, 'c'},
+        {"period", required_argument, NULL, 'P'},
+        {"bpm", required_argument, NULL, 'b'},
+        {"decay", required_argument, NULL, 'D'},
+        {"spread", required_argument, NULL, 'S'},
+        {NULL, 0, NULL, 0}
+    };
+    int option;
+    while ((option = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (option) {
+            case 'e': effect_name = optarg; break;
+            case 'f': fixture_list = optarg; break;
+            case 't': tick_ms = atoi(optarg); break;
+            case 'd': duration = atof(optarg); break;
+            case 'k': keyframe_ms = atoi(optarg); break;
+            case 'o':
+                if (strcmp(optarg, "frame") == 0) output = OUTPUT_FRAME;
+                else if (strcmp(optarg, "topics") == 0) output = OUTPUT_TOPICS;
+                else { usage(); return 1; }
+                break;
+            case 'm': max_payload = atoi(optarg); break;
+            case 'h': broker = optarg; break;
+            case 'p': port = atoi(optarg); break;
+            case 'w': file_path = optarg; break;
+            case 'x': offline = true; break;
+            case 's': sync = true; break;
+            case 'r': realtime = true; break;
+            case 'c':
+                if (!parseColor(optarg, options.color)) { usage(); return 1; }
+                break;
+            case 'P': options.period = atoi(optarg); break;
+            case 'b': options.bpm = atof(optarg); break;
+            case 'D': options.decay = atof(optarg); break;
+            case 'S': options.spread = atof(optarg); break;
+            default: usage(); return 1;
+        }
+    }
+    std::vector<uint8_t> addresses;
+    if (tick_ms == 0 || options.period == 0 || options.bpm <= 0 || options.decay <= 0
+            || !parseFixtures(fixture_list, addresses)) {
+        usage();
+        return 1;
+    }
+    if (offline && !file_path) {
+        fprintf(stderr, "--offline needs --file\n");
+        return 1;
+    }
+    Effect *effect = makeEffect(effect_name, options);
+    if (!effect) {
+        fprintf(stderr, "Unknown effect %s\n", effect_name);
+        return 1;
+    }
+
+    Sink *sink;
+    MqttSink *mqtt = NULL;
+    if (file_path) {
+        FILE *file = strcmp(file_path, "-") == 0 ? stdout : fopen(file_path, "wb");
+        if (!file) {
+            perror(file_path);
+            return 1;
+        }
+        sink = new FileSink(file);
+    } else {
+        sink = mqtt = new MqttSink();
+        if (!mqtt->connect(broker, port, "effect_engine")) {
+            fprintf(stderr, "Failed to connect to %s:%u\n", broker, port);
+            return 1;
+        }
+    }
+
+    if (realtime) {
+        struct sched_param param = {};
+        param.sched_priority = sched_get_priority_max(SCHED_FIFO) / 2;
+        if (sched_setscheduler(0, SCHED_FIFO, &param) != 0) perror("SCHED_FIFO");
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) perror("mlockall");
+    }
+    struct sigaction action = {};
+    action.sa_handler = onSignal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    DeltaEncoder encoder(addresses, output, max_payload);
+    Frame frame(addresses.size());
+    std::vector<Message> messages;
+    messages.reserve(addresses.size() + 1);
+    TimeHistogram lateness, render_times, publish_times;
+    uint64_t frames = 0, skipped = 0, sent = 0, bytes = 0, channels = 0, failed = 0;
+    uint64_t tick_ns = tick_ms * 1000000ULL;
+    uint64_t duration_ms = (uint64_t)(duration * 1000);
+    uint64_t next_keyframe = 0, last_connect = 0;
+    bool resync = false;
+
+    uint64_t start = monotonicNanos();
+    for (uint64_t tick = 0; running; tick++) {
+        uint64_t deadline = start + tick * tick_ns;
+        if (!offline) {
+            sleepUntil(deadline);
+            uint64_t late = monotonicNanos() - deadline;
+            if (late >= tick_ns) {
+                skipped += late / tick_ns;
+                tick += late / tick_ns;
+                late %= tick_ns;
+            }
+            lateness.add(late);
+        }
+        uint64_t show_time = tick * tick_ms;
+        if (duration_ms && show_time >= duration_ms) break;
+
+        if (mqtt && !mqtt->connected()) {
+            uint64_t now = monotonicNanos();
+            if (now - last_connect < RECONNECT_NS) {
+                failed++;
+                continue;
+            }
+            last_connect = now;
+            if (!mqtt->connect(broker, port, "effect_engine")) {
+                failed++;
+                continue;
+            }
+            resync = true;
+        }
+
+        uint64_t render_start = monotonicNanos();
+        bool keyframe = resync || show_time >= next_keyframe;
+        if (keyframe) next_keyframe = keyframe_ms ? (show_time / keyframe_ms + 1) * keyframe_ms : UINT64_MAX;
+        resync = false;
+        messages.clear();
+        if (sync && keyframe) messages.push_back({SYNC_TOPIC, std::to_string(show_time)});
+        effect->render(show_time, frame);
+        channels += encoder.encode(frame, keyframe, messages);
+        uint64_t publish_start = monotonicNanos();
+        render_times.add(publish_start - render_start);
+
+        bool ok = true;
+        for (size_t i = 0; i < messages.size() && ok; i++) {
+            ok = sink->publish(show_time, messages[i].topic, messages[i].payload);
+            bytes += messages[i].topic.size() + messages[i].payload.size();
+        }
+        ok = ok && sink->flush();
+        if (!ok) failed++;
+        else sent += messages.size();
+        publish_times.add(monotonicNanos() - publish_start);
+        frames++;
+    }
+    double elapsed = (monotonicNanos() - start) / 1e9;
+    delete sink;
+    delete effect;
+
+    fprintf(stderr, "%llu frames in %.2f s (%.0f/s), %llu ticks skipped, %llu failed\n",
+        (unsigned long long)frames, elapsed, frames / elapsed, (unsigned long long)skipped, (unsigned long long)failed);
+    fprintf(stderr, "%llu messages, %llu bytes (%.1f per frame), %llu of %llu channels sent (%.1f%%)\n",
+        (unsigned long long)sent, (unsigned long long)bytes, frames ? (double)bytes / frames : 0.0,
+        (unsigned long long)channels, (unsigned long long)(frames * addresses.size() * 3),
+        frames ? 100.0 * channels / (frames * addresses.size() * 3) : 0.0);
+    if (!offline) printTimes("lateness", lateness);
+    printTimes("render", render_times);
+    printTimes("publish", publish_times);
+    return 0;
+}
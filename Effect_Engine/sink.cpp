@@ -0,0 +1,145 @@
+#include "sink.hpp"
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MQTTCONNECT 0x10
+#define MQTTCONNACK 0x20
+#define MQTTPUBLISH 0x30
+#define MQTTPINGREQ 0xC0
+#define MQTTDISCONNECT 0xE0
+
+uint64_t monotonicNanos() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+MqttSink::~MqttSink() {
+    if (socket_fd >= 0) writePacket(MQTTDISCONNECT, "");
+    disconnectSocket();
+}
+
+void MqttSink::disconnectSocket() {
+    if (socket_fd >= 0) close(socket_fd);
+    socket_fd = -1;
+}
+
+/*
+    Send fixed header, remaining length and body
+*/
+bool MqttSink::writePacket(uint8_t header, const std::string &body) {
+    if (socket_fd < 0) return false;
+    std::string packet(1, (char)header);
+    size_t remaining = body.size();
+    do {
+        uint8_t digit = remaining % 128;
+        remaining /= 128;
+        if (remaining > 0) digit |= 0x80;
+        packet += (char)digit;
+    } while (remaining > 0);
+    packet += body;
+
+    size_t sent = 0;
+    while (sent < packet.size()) {
+        ssize_t n = send(socket_fd, packet.data() + sent, packet.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            disconnectSocket();
+            return false;
+        }
+        sent += n;
+    }
+    last_out_activity = monotonicNanos();
+    return true;
+}
+
+static std::string lengthPrefixed(const std::string &value) {
+    std::string out;
+    out += (char)(value.size() >> 8);
+    out += (char)(value.size() & 0xFF);
+    return out + value;
+}
+
+bool MqttSink::connect(const char *host, uint16_t port, const char *id) {
+    disconnectSocket();
+
+    char port_string[8];
+    snprintf(port_string, sizeof(port_string), "%u", port);
+    struct addrinfo hints = {};
+    struct addrinfo *address;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, port_string, &hints, &address) != 0) return false;
+    socket_fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    if (socket_fd < 0 || ::connect(socket_fd, address->ai_addr, address->ai_addrlen) != 0) {
+        freeaddrinfo(address);
+        disconnectSocket();
+        return false;
+    }
+    freeaddrinfo(address);
+    int on = 1;
+    setsockopt(socket_fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    const char variable_header[] = {0, 4, 'M', 'Q', 'T', 'T', 4, 0x02, 0, MQTT_KEEPALIVE};
+    std::string body(variable_header, sizeof(variable_header));
+    if (!writePacket(MQTTCONNECT, body + lengthPrefixed(id))) return false;
+
+    // wait for CONNACK, {0x20, 2, flags, return code}
+    struct timeval timeout = {5, 0};
+    setsockopt(socket_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    uint8_t connack[4];
+    size_t received = 0;
+    while (received < sizeof(connack)) {
+        ssize_t n = recv(socket_fd, connack + received, sizeof(connack) - received, 0);
+        if (n <= 0) {
+            disconnectSocket();
+            return false;
+        }
+        received += n;
+    }
+    if ((connack[0] & 0xF0) != MQTTCONNACK || connack[3] != 0) {
+        disconnectSocket();
+        return false;
+    }
+    return true;
+}
+
+bool MqttSink::publish(uint32_t show_time, const std::string &topic, const std::string &payload) {
+    return writePacket(MQTTPUBLISH, lengthPrefixed(topic) + payload);
+}
+
+bool MqttSink::flush() {
+    if (socket_fd < 0) return false;
+    char discard[256];
+    ssize_t n;
+    while ((n = recv(socket_fd, discard, sizeof(discard), MSG_DONTWAIT)) > 0);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        disconnectSocket();
+        return false;
+    }
+    if (monotonicNanos() - last_out_activity > MQTT_KEEPALIVE * 1000000000ULL / 2) {
+        return writePacket(MQTTPINGREQ, "");
+    }
+    return true;
+}
+
+FileSink::~FileSink() {
+    fclose(file);
+}
+
+bool FileSink::publish(uint32_t show_time, const std::string &topic, const std::string &payload) {
+    uint8_t header[8] = {
+        (uint8_t)show_time, (uint8_t)(show_time >> 8), (uint8_t)(show_time >> 16), (uint8_t)(show_time >> 24),
+        (uint8_t)topic.size(), (uint8_t)(topic.size() >> 8),
+        (uint8_t)payload.size(), (uint8_t)(payload.size() >> 8)
+    };
+    return fwrite(header, sizeof(header), 1, file) == 1
+        && fwrite(topic.data(), 1, topic.size(), file) == topic.size()
+        && fwrite(payload.data(), 1, payload.size(), file) == payload.size();
+}
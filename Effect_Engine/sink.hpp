@@ -0,0 +1,62 @@
+#ifndef SINK_HPP
+#define SINK_HPP
+
+/*  Outputs for the effect engine's messages
+
+    MqttSink publishes to a broker, MQTT 3.1.1 at QoS 0
+    over a TCP socket with Nagle off, so each tick's messages
+    leave as soon as they are written.
+
+    FileSink writes them to a file for offline benchmarks,
+    each message as a record of
+        show time    uint32, ms
+        topic size   uint16
+        payload size uint16
+        topic, payload
+    numbers little endian.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+#define MQTT_KEEPALIVE 15
+
+class Sink {
+public:
+    virtual ~Sink() {}
+    virtual bool publish(uint32_t show_time, const std::string &topic, const std::string &payload) = 0;
+    // called once per tick after the tick's messages
+    virtual bool flush() { return true; }
+};
+
+class MqttSink : public Sink {
+private:
+    int socket_fd = -1;
+    uint64_t last_out_activity = 0;
+    bool writePacket(uint8_t header, const std::string &body);
+    void disconnectSocket();
+public:
+    ~MqttSink();
+    bool connect(const char *host, uint16_t port, const char *id);
+    bool connected() { return socket_fd >= 0; }
+    bool publish(uint32_t show_time, const std::string &topic, const std::string &payload);
+    // keepalive, discards what the broker sends
+    bool flush();
+};
+
+class FileSink : public Sink {
+private:
+    FILE *file;
+public:
+    FileSink(FILE *file) : file(file) {}
+    ~FileSink();
+    bool publish(uint32_t show_time, const std::string &topic, const std::string &payload);
+};
+
+/*
+    Monotonic clock, ns
+*/
+uint64_t monotonicNanos();
+
+#endif /* ifndef SINK_HPP */
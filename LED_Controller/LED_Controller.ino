@@ -1,7 +1,12 @@
+#include <EEPROM.h>
+#include "logger.hpp"
+#include "taskstore.hpp"
 #include "scheduler.hpp"
 #include "stringutil.hpp"
 #include "input.hpp"
 #include "states.hpp"
+#include "telemetry.hpp"
+#include "show.hpp"
 
 /* @author Daniel Amos Grenehed
 
@@ -37,7 +42,18 @@
   time in milliseconds to run the
   task), which state to run,
   and parameters to set at the start
-  of the task.
+  of the task. Any of them can be
+  left out.
+
+  Tasks are added to one of
+  MAX_TRACKS tracks that run side
+  by side, the higher numbered
+  track wins where two tasks set
+  the same value.
+
+  Tasks are stored packed, in RAM
+  or, for longer programs, in EEPROM
+  or PROGMEM (show.hpp).
 
 */
 
@@ -52,6 +68,7 @@
 
 Scheduler *scheduler;
 StateMachine *state_machine;
+Telemetry *telemetry;
 
 // State parameters
 
@@ -74,6 +91,37 @@ struct FunctionLink {
   void (*function)(char *input, int len);
 };
 
+/*
+  Function listing, printed one line at a time by printFunctionsNext
+*/
+const FunctionLink *listed_functions;
+int listed_count = 0;
+int listed_index = 0;
+
+/*
+  Log producer, prints next function of listing
+*/
+bool printFunctionsNext() {
+  if (listed_index >= listed_count) return false;
+  Log.print(F("\t"));
+  Log.print(listed_functions[listed_index].name);
+  Log.print(F(" - "));
+  Log.println(listed_functions[listed_index].description);
+  listed_index++;
+  return listed_index < listed_count;
+}
+
+/*
+  Start printing names and descriptions of functions
+*/
+void printFunctions(const FunctionLink *functions, int count) {
+  if (!logEnabled(LOG_INFO)) return;
+  listed_functions = functions;
+  listed_count = count;
+  listed_index = 0;
+  Log.setProducer(printFunctionsNext);
+}
+
 /*
   Set LED Brightness
 */
@@ -84,29 +132,22 @@ void setOverallIntensity(byte brightness) {
 /*
   Print on or off
 */
-void printlnBool(bool tf) {
-  Serial.println(tf ? F("On") : F("Off"));
+void printlnBool(Print &out, bool tf) {
+  out.println(tf ? F("On") : F("Off"));
 }
 
 /*
   Print error
 */
 void printArgumentError() {
-  Serial.print(F("Err"));
-}
-
-/*
-  Print acceptable input range for byte
-*/
-void printlnByteRange() {
-  Serial.println(F(" (0 <=> 255)"));
+  Log.print(F("Err"));
 }
 
 /*
   Print Task error
 */
 void printlnInvalidTask() {
-  Serial.println(F("InvalTask Err"));
+  Log.println(F("InvalTask Err"));
 }
 
 /*
@@ -132,6 +173,8 @@ void writeLEDColor() {
   analogWrite(RED_DIODE_PIN, 255 - calculateBrightness(RED));
   analogWrite(GREEN_DIODE_PIN, 255 - calculateBrightness(GREEN));
   analogWrite(BLUE_DIODE_PIN, 255 - calculateBrightness(BLUE));
+  // mark a traced UART color as shown
+  if (trace_id != 0 && trace_led_written == 0) trace_led_written = micros();
 }
 
 /*
@@ -153,31 +196,105 @@ byte getDiodeIntensity(byte d) {
 //
 
 /*
-  Start scheduler
+  Argument schemas for the serial commands, in PROGMEM
+*/
+const static ArgumentSpec TrackArgument[] PROGMEM = {{"trk", 0, MAX_TRACKS - 1, true}};
+const static ArgumentSpec SourceArguments[] PROGMEM = {
+  {"trk", 0, MAX_TRACKS - 1, false},
+  {"src", STORE_RAM, STORE_PROGMEM, false}
+};
+const static ArgumentSpec IndexArguments[] PROGMEM = {
+  {"trk", 0, MAX_TRACKS - 1, false},
+  {"idx", 0, MAX_TASKS - 1, false}
+};
+const static ArgumentSpec MoveArguments[] PROGMEM = {
+  {"trk", 0, MAX_TRACKS - 1, false},
+  {"from", 0, MAX_TASKS - 1, false},
+  {"to", 0, MAX_TASKS - 1, false}
+};
+// track [index] duration [state p1 p2 s], the task starts at TASK_ARGUMENTS_START
+const static ArgumentSpec TaskArguments[] PROGMEM = {
+  {"trk", 0, MAX_TRACKS - 1, false},
+  {"idx", 0, MAX_TASKS - 1, false},
+  {"dur", 0, 2147483647L, false},
+  {"state", 0, NUM_STATES - 1, true},
+  {"p1", 0, 255, true},
+  {"p2", 0, 255, true},
+  {"s", 0, 2, true}
+};
+#define TASK_ARGUMENTS_START 2
+#define TASK_ARGUMENTS 5
+const static ArgumentSpec AddTaskArguments[] PROGMEM = {
+  {"trk", 0, MAX_TRACKS - 1, false},
+  {"dur", 0, 2147483647L, false},
+  {"state", 0, NUM_STATES - 1, true},
+  {"p1", 0, 255, true},
+  {"p2", 0, 255, true},
+  {"s", 0, 2, true}
+};
+const static ArgumentSpec KeyArgument[] PROGMEM = {{"key", 0, 1, false}};
+const static ArgumentSpec ByteArgument[] PROGMEM = {{"val", 0, 255, false}};
+const static ArgumentSpec LEDArgument[] PROGMEM = {{"led", 0, 2, false}};
+const static ArgumentSpec StateArgument[] PROGMEM = {{"state", 0, NUM_STATES - 1, false}};
+const static ArgumentSpec LogArgument[] PROGMEM = {{"lvl", LOG_ERROR, LOG_VERBOSE, true}};
+const static ArgumentSpec TelemetryArgument[] PROGMEM = {{"ms", 0, 60000, true}};
+const static ArgumentSpec SyncArgument[] PROGMEM = {{"ms", 0, 2147483647L, false}};
+const static ArgumentSpec AddressArguments[] PROGMEM = {
+  {"id", BROADCAST_ADDRESS, MAX_BUS_ADDRESS, true},
+  {"grp", 0, 255, true}
+};
+
+/*
+  Parses optional track argument, calls function
+  for that track or for every track if left out
+*/
+void forTracks(char* input, int len, void (Scheduler::*function)(int)) {
+  long track;
+  int count = parseArguments(input, len, TrackArgument, 1, &track);
+  if (count < 0) return;
+  if (count == 1 && track != SKIPPED_ARGUMENT) (scheduler->*function)(track);
+  else for (int i = 0; i < MAX_TRACKS; i++) (scheduler->*function)(i);
+}
+
+/*
+  Start track, or all tracks with tasks
 */
 void schedulerStart(char* input, int len) {
-  scheduler->start();
+  long track;
+  int count = parseArguments(input, len, TrackArgument, 1, &track);
+  if (count < 0) return;
+  if (count == 1 && track != SKIPPED_ARGUMENT) scheduler->start(track);
+  else {
+    bool started = false;
+    for (int i = 0; i < MAX_TRACKS; i++) {
+      if (scheduler->taskCount(i) > 0) {
+        scheduler->start(i);
+        started = true;
+      }
+    }
+    if (!started) Log.println(F("No tasks!"));
+  }
 }
 
 /*
-  Stop scheduler
+  Stop track, or all tracks
 */
 void schedulerStop(char* input, int len) {
-  scheduler->stop();
+  forTracks(input, len, &Scheduler::stop);
 }
 
 /*
-  Set scheduler to loop mode
+  Set track, or all tracks, to loop mode
 */
 void schedulerLoop(char* input, int len) {
-  scheduler->enableLoop();
+  forTracks(input, len, &Scheduler::enableLoop);
 }
 
 /*
-  Disables scheduler loop mode 
+  Disables loop mode of track, or all tracks
 */
 void schedulerNoLoop(char* input, int len) {
-  scheduler->disableLoop();
+  forTracks(input, len, &Scheduler::disableLoop);
 }
 
 /*
@@ -195,78 +312,108 @@ void schedulerTasks(char* input, int len) {
 } 
 
 /*
-  Remove task at index from schedule (0 <=> task_count-1)
+  Remove task at index from track (0 <=> task_count-1)
 */
 void schedulerRemoveTask(char* input, int len) {
-  int start = 0;
-  int tmp = getNumericArgument(input, len, &start);
-  scheduler->removeTask(tmp);
+  long args[2]; // track, index
+  if (parseArguments(input, len, IndexArguments, 2, args) < 0) return;
+  scheduler->removeTask(args[0], args[1]);
 } 
 
 /*
-  Move task in schedule from x to y (0 <=> task_count-1)
+  Move task in track from x to y (0 <=> task_count-1)
   Shifts tasks between x and y one step towards x
 */
 void schedulerMoveTask(char* input, int len) {
-  int start = 0;
-  int from = getNumericArgument(input, len, &start); // get first argument
-  int to = getNumericArgument(input+start, len-start, &start); // get second argument
-  if (from < 0 || to < 0) return;
-  scheduler->moveTask(from, to);
+  long args[3]; // track, from, to
+  if (parseArguments(input, len, MoveArguments, 3, args) < 0) return;
+  scheduler->moveTask(args[0], args[1], args[2]);
+}
+
+/*
+  Sets where the tasks of a track are kept,
+  0 RAM, 1 EEPROM, 2 PROGMEM program
+*/
+void schedulerSource(char* input, int len) {
+  long args[2]; // track, source
+  if (parseArguments(input, len, SourceArguments, 2, args) < 0) return;
+  scheduler->setSource(args[0], args[1]);
+}
+
+/*
+  Moves running tracks to a shared show time,
+  also called for UART sync frames
+*/
+void syncSchedule(unsigned long show_time) {
+  scheduler->sync(show_time);
+}
+
+/*
+  Sync running tracks to show time ms
+*/
+void schedulerSync(char* input, int len) {
+  long show_time;
+  if (parseArguments(input, len, SyncArgument, 1, &show_time) < 0) return;
+  syncSchedule(show_time);
+}
+
+/*
+  Builds a task from parsed duration and optional state and parameters.
+  Only values given (and not skipped with "-") are set by the task
+*/
+Task taskFromArguments(const long *args, int count) {
+  Task task = {args[0], 0, 0, 0, 0, 0};
+  for (int i = 1; i < count; i++) {
+    if (args[i] == SKIPPED_ARGUMENT) continue;
+    task.fields |= 1 << (i - 1);
+    switch (i) {
+      case 1: task.state = args[i]; break;
+      case 2: task.param_1 = args[i]; break;
+      case 3: task.param_2 = args[i]; break;
+      case 4: task.selection = args[i]; break;
+    }
+  }
+  return task;
 }
 
 /*
-  Appends new task to schedule
+  Appends new task to track
 */
 void schedulerAddTask(char* input, int len) {
-  int start = 0;
-  long duration = getNumericArgument(input, len, &start);
-  byte state = getNumericArgument(input+start, len-start, &start);
-  if (duration < 0 || state < 0) {
+  long args[1 + TASK_ARGUMENTS];
+  int count = parseArguments(input, len, AddTaskArguments, 1 + TASK_ARGUMENTS, args);
+  if (count < 0) {
     printlnInvalidTask();
     return;
   }
-  int p1 = getNumericArgument(input+start, len-start, &start);
-  int p2 = getNumericArgument(input+start, len-start, &start);
-  int s = getNumericArgument(input+start, len-start, &start);
-
-  if (p1 < 0 || p2 < 0 || s < 0) {
-    scheduler->addTask({duration, state, 0, 0, 0, false});
-  } else {
-    scheduler->addTask({duration, state, (byte)p1, (byte)p2, (byte)s, true});
-  }
+  scheduler->addTask(args[0], taskFromArguments(args + 1, count - 1));
 }
 
 /*
-  Sets schedule task at index to new task
+  Sets track task at index to new task
 */
 void schedulerUpdateTask(char* input, int len) {
-  int start = 0;
-  int index = getNumericArgument(input, len, &start);
-  long duration = getNumericArgument(input+start, len-start, &start);
-  byte state = getNumericArgument(input+start, len-start, &start);
-  if (duration < 0 || state < 0) {
+  long args[TASK_ARGUMENTS_START + TASK_ARGUMENTS];
+  int count = parseArguments(input, len, TaskArguments, TASK_ARGUMENTS_START + TASK_ARGUMENTS, args);
+  if (count < 0) {
     printlnInvalidTask();
     return;
   }
-  int p1 = getNumericArgument(input+start, len-start, &start);
-  int p2 = getNumericArgument(input+start, len-start, &start);
-  int s = getNumericArgument(input+start, len-start, &start);
-
-  if (p1 < 0 || p2 < 0 || s < 0) {
-    scheduler->updateTask(index, {duration, state, 0, 0, 0, false});
-  } else {
-    scheduler->updateTask(index, {duration, state, (byte)p1, (byte)p2, (byte)s, true});
-  }
+  scheduler->updateTask(args[0], args[1], taskFromArguments(args + TASK_ARGUMENTS_START, count - TASK_ARGUMENTS_START));
 }
 
 // To be able to add to SchedulerMap
 void schedulerHelp(char* input, int len);
 
+// Input callbacks, used by the key and pot commands
+void onKey1Event(bool pressed);
+void onKey2Event(bool pressed);
+void onPotValueChanged(byte new_value);
+
 /*
   Mapping commands and descriptions to Scheduler functions
 */
-#define SCHEDULER_FUNCTIONS 11
+#define SCHEDULER_FUNCTIONS 13
 const static FunctionLink SchedulerMap[] = {
   {"run", "Run", schedulerStart},
   {"sp", "Stop", schedulerStop}, 
@@ -278,6 +425,8 @@ const static FunctionLink SchedulerMap[] = {
   {"ad", "Append tsk", schedulerAddTask},
   {"ud", "Update tsk", schedulerUpdateTask}, 
   {"mv", "Move tsk", schedulerMoveTask},
+  {"src", "Tsk source", schedulerSource},
+  {"sync", "Sync show ms", schedulerSync},
   {"hlp", "Help msg", schedulerHelp}
 };
 
@@ -285,13 +434,22 @@ const static FunctionLink SchedulerMap[] = {
   Print Scheduler functions
 */
 void schedulerHelp(char* input, int len) {
-   Serial.println(F("Scheduler: "));
-  for (int i = 0; i < SCHEDULER_FUNCTIONS; i++) {
-    Serial.print(F("\t"));
-    Serial.print(SchedulerMap[i].name);
-    Serial.print(F(" - "));
-    Serial.println(SchedulerMap[i].description);
-  }
+  logAt(LOG_INFO).println(F("Scheduler: "));
+  printFunctions(SchedulerMap, SCHEDULER_FUNCTIONS);
+}
+
+/*
+  Log producer for Scheduler::printSchedule
+*/
+bool printScheduleNext() {
+  return scheduler->printNextTask();
+}
+
+/*
+  Log producer for Scheduler::printStatus
+*/
+bool printStatusNext() {
+  return scheduler->printNextStatus();
 }
 
 /*
@@ -313,8 +471,8 @@ void schedulerCommand(char* input, int len) {
   Emit Key1 event (0 | 1)
 */
 void button1(char* input, int len) {
-  int start = 0;
-  int tmp = getNumericArgument(input, len, &start);
+  long tmp;
+  if (parseArguments(input, len, KeyArgument, 1, &tmp) < 0) return;
   if (tmp == 1) onKey1Event(true);      // Key 1 Press
   else if (tmp == 0) onKey2Event(false);// Key 1 Release
 }
@@ -323,8 +481,8 @@ void button1(char* input, int len) {
   Emit Key2 event (0 | 1)
 */
 void button2(char* input, int len) {
-  int start = 0;
-  int tmp = getNumericArgument(input, len, &start);
+  long tmp;
+  if (parseArguments(input, len, KeyArgument, 1, &tmp) < 0) return;
   if (tmp == 1) onKey2Event(true);      // Key 2 Press
   else if (tmp == 0) onKey2Event(false);// Key 2 Release
 }
@@ -333,84 +491,70 @@ void button2(char* input, int len) {
   Emit PotChanged event (0 <=> 255)
 */
 void pot(char* input, int len) {
-  int start = 0;
-  int tmp = getNumericArgument(input, len, &start);
-  if (tmp > 255 || tmp < 0) {
-    printArgumentError();
-    Serial.print(tmp);
-    printlnByteRange();
-  } else onPotValueChanged((byte) tmp);
+  long tmp;
+  if (parseArguments(input, len, ByteArgument, 1, &tmp) < 0) return;
+  onPotValueChanged((byte) tmp);
 }
 
 /*
   Sets param_1 (0 <=> 255)
 */
 void setParam1(char *input, int len) {
-  int start = 0;
-  int tmp = getNumericArgument(input, len, &start);
-  if (tmp >= 0 && tmp < 256) param_1 = tmp;
-  else {
-    printArgumentError();
-    printlnByteRange();
-  }
+  long tmp;
+  if (parseArguments(input, len, ByteArgument, 1, &tmp) < 0) return;
+  param_1 = tmp;
 }
 
 /*
   Sets param_2 (0 <=> 255)
 */
 void setParam2(char *input, int len) {
-  int start = 0;
-  int tmp = getNumericArgument(input, len, &start);
-  if (tmp >= 0 && tmp < 256) param_2 = tmp;
-  else {
-    printArgumentError();
-    printlnByteRange();
-  }
+  long tmp;
+  if (parseArguments(input, len, ByteArgument, 1, &tmp) < 0) return;
+  param_2 = tmp;
 }
 
 /*
   Sets LED selection (0 <=> 2)
 */
 void setSelection(char *input, int len) {
-  int start = 0;
-  int tmp = getNumericArgument(input, len, &start);
-  if (tmp >= 0 && tmp < 3) selectedLED = tmp;
-  else {
-    printArgumentError();
-    Serial.println(F("(0 <=> 2)"));
-  } 
+  long tmp;
+  if (parseArguments(input, len, LEDArgument, 1, &tmp) < 0) return;
+  selectedLED = tmp;
 }
 
 /*
   Print info on current state
 */
 void currentState(char *input, int len) {
-  Serial.print(F("State "));
-  Serial.print(state_machine->stateNumber());
-  Serial.println(F(":"));
+  Print &out = logAt(LOG_INFO);
+  out.print(F("State "));
+  out.print(state_machine->stateNumber());
+  out.println(F(":"));
 
-  state_machine->currentState()->printInfo();
-  Serial.print(F("\tP1: "));
-  Serial.println(param_1);
-  Serial.print(F("\tP2: "));
-  Serial.println(param_2);
-  Serial.print(F("\tS: "));
-  Serial.println(selectedLED);
+  state_machine->currentState()->printInfo(out);
+  out.print(F("\tP1: "));
+  out.println(param_1);
+  out.print(F("\tP2: "));
+  out.println(param_2);
+  out.print(F("\tS: "));
+  out.println(selectedLED);
 }
 
 /*
   Prints the values of the color
 */
 void currentColor(char *input, int len) {
-  Serial.println(F("Color:"));
-  Serial.print(F("\tR: "));
-  Serial.println(RED);
-  Serial.print(F("\tG: "));
-  Serial.println(GREEN);
-  Serial.print(F("\tB: "));
-  Serial.println(BLUE);
-  Serial.print(F("\tBs: "));
-  Serial.println(RGBB_Data[3]);
+  Print &out = logAt(LOG_INFO);
+  out.println(F("Color:"));
+  out.print(F("\tR: "));
+  out.println(RED);
+  out.print(F("\tG: "));
+  out.println(GREEN);
+  out.print(F("\tB: "));
+  out.println(BLUE);
+  out.print(F("\tBs: "));
+  out.println(RGBB_Data[3]);
 }
 
 /*
@@ -418,14 +562,18 @@ void currentColor(char *input, int len) {
 */
 void toNextState(char *input, int len) {
   state_machine->nextState();
+  if (logEnabled(LOG_VERBOSE)) return; // already printed by setState
+  Print &out = logAt(LOG_INFO);
+  out.print(F("State: "));
+  out.println(state_machine->stateNumber());
 }
 
 /*
   Enables state (0 <=> 3)
 */
 void enableState(char *input, int len) {
-  int start = 0;
-  int tmp = getNumericArgument(input, len, &start);
+  long tmp;
+  if (parseArguments(input, len, StateArgument, 1, &tmp) < 0) return;
   state_machine->enableState(tmp);
 }
 
@@ -433,8 +581,8 @@ void enableState(char *input, int len) {
   Disables state (0 <=> 3)
 */
 void disableState(char *input, int len) {
-  int start = 0;
-  int tmp = getNumericArgument(input, len, &start);
+  long tmp;
+  if (parseArguments(input, len, StateArgument, 1, &tmp) < 0) return;
   state_machine->disableState(tmp);
 }
 
@@ -443,14 +591,107 @@ void disableState(char *input, int len) {
 */
 void toNextLED(char *input, int len) {
   nextLED();
-  Serial.print(F("Current LED: "));
-  Serial.println(selectedLED);
+  Print &out = logAt(LOG_INFO);
+  out.print(F("Current LED: "));
+  out.println(selectedLED);
+}
+
+/*
+  Print log level and dropped messages,
+  or set log level (0 errors, 1 info, 2 verbose)
+*/
+void logLevel(char *input, int len) {
+  long tmp;
+  int count = parseArguments(input, len, LogArgument, 1, &tmp);
+  if (count < 0) return;
+  if (count == 1) Log.level = tmp;
+  Log.print(F("Log: "));
+  Log.print(Log.level);
+  Log.print(F(", dropped "));
+  Log.println(Log.droppedMessages());
+}
+
+/*
+  Print telemetry period and skipped frames,
+  or set period in ms (0 turns telemetry off)
+*/
+void telemetryPeriod(char *input, int len) {
+  long tmp;
+  int count = parseArguments(input, len, TelemetryArgument, 1, &tmp);
+  if (count < 0) return;
+  if (count == 1) telemetry->setPeriod(tmp);
+  Print &out = logAt(LOG_INFO);
+  out.print(F("Tlm: "));
+  out.print(telemetry->getPeriod());
+  out.print(F("ms, skipped "));
+  out.println(telemetry->skippedFrames());
+}
+
+/*
+  EEPROM location of the bus address, followed by the group bits,
+  after the scheduler's track sources
+*/
+#define ADDRESS_EEPROM (SOURCES_EEPROM + 1)
+
+/*
+  Load bus address and groups from EEPROM,
+  an erased EEPROM gives address 0 and no groups
+*/
+void loadBusAddress() {
+  bus_address = EEPROM.read(ADDRESS_EEPROM);
+  bus_groups = EEPROM.read(ADDRESS_EEPROM + 1);
+  if (bus_address > MAX_BUS_ADDRESS) {
+    bus_address = BROADCAST_ADDRESS;
+    bus_groups = 0;
+  }
+}
+
+/*
+  Print bus address and group bits,
+  or set and store them (address 0 only takes broadcasts)
+*/
+void busAddress(char *input, int len) {
+  long args[2]; // address, groups
+  int count = parseArguments(input, len, AddressArguments, 2, args);
+  if (count < 0) return;
+  if (count >= 1 && args[0] != SKIPPED_ARGUMENT) bus_address = args[0];
+  if (count == 2 && args[1] != SKIPPED_ARGUMENT) bus_groups = args[1];
+  if (count > 0) {
+    EEPROM.update(ADDRESS_EEPROM, bus_address);
+    EEPROM.update(ADDRESS_EEPROM + 1, bus_groups);
+  }
+  Print &out = logAt(LOG_INFO);
+  out.print(F("ID: "));
+  out.print(bus_address);
+  out.print(F(", grp: "));
+  out.println(bus_groups, BIN);
+}
+
+/*
+  Fill telemetry snapshot with current device values
+*/
+void fillTelemetry(TelemetrySnapshot *snapshot) {
+  snapshot->state = state_machine->stateNumber();
+  snapshot->param_1 = param_1;
+  snapshot->param_2 = param_2;
+  snapshot->selected_led = selectedLED;
+  for (int i = 0; i < 4; i++) snapshot->rgbb[i] = RGBB_Data[i];
+  snapshot->scheduler_flags = 0;
+  for (int i = 0; i < MAX_TRACKS; i++) {
+    if (scheduler->isRunning(i)) snapshot->scheduler_flags |= 1 << i;
+    if (scheduler->isLooping(i)) snapshot->scheduler_flags |= 0x10 << i;
+    snapshot->task[i] = scheduler->currentTask(i);
+    snapshot->task_elapsed[i] = scheduler->taskElapsed(i);
+  }
+  snapshot->log_dropped = Log.droppedMessages();
+  snapshot->command_errors = command_errors;
+  snapshot->uart_errors = uart_errors;
 }
 
 // To be able to add to FunctionMap
 void printHelp(char* input, int len);
 
-#define MAPPED_FUNCTIONS 14
+#define MAPPED_FUNCTIONS 17
 
 /*
     Maps Command and description to function
@@ -469,20 +710,18 @@ const static FunctionLink FunctionMap[] = {
     {"schd", "Scheduler", schedulerCommand},
     {"help", "Help msg", printHelp},
     {"enbl", "Enable state", enableState},
-    {"dsbl", "Disable state", disableState}
+    {"dsbl", "Disable state", disableState},
+    {"log", "Log level", logLevel},
+    {"tlm", "Telemetry ms", telemetryPeriod},
+    {"id", "Bus address", busAddress}
 };
 
 /*
   Print commands and descriptions
 */
 void printHelp(char *input, int len) {
-  Serial.println(F("Functions: "));
-  for (int i = 0; i < MAPPED_FUNCTIONS; i++) {
-    Serial.print(F("\t"));
-    Serial.print(FunctionMap[i].name);
-    Serial.print(F(" - "));
-    Serial.println(FunctionMap[i].description);
-  }
+  logAt(LOG_INFO).println(F("Functions: "));
+  printFunctions(FunctionMap, MAPPED_FUNCTIONS);
 }
 
 /*
@@ -501,8 +740,9 @@ void processCommands(char *input, int len) {
   }
   // Input matched no function
   // Print error
-  Serial.print(F("No fun_"));
-  Serial.println(input);
+  command_errors++;
+  Log.print(F("No fun_"));
+  Log.println(input);
 }
 
 
@@ -517,7 +757,7 @@ void handleSerial() {
       // on newline char, replace with string terminator
       command_buffer[buffer_pos] = 0;
       // echo input and evaluate command
-      Serial.println(command_buffer);
+      logAt(LOG_INFO).println(command_buffer);
       processCommands(command_buffer, buffer_pos);
       // *reset* buffer for new command 
       buffer_pos = 0; 
@@ -527,7 +767,8 @@ void handleSerial() {
       buffer_pos++; 
       if (buffer_pos >= BUFFER_SIZE) {
         // If command too long, print error and *reset* buffer  
-        Serial.println(F("CmdErr"));
+        command_errors++;
+        Log.println(F("CmdErr"));
         buffer_pos = 0;
       }
     }
@@ -549,12 +790,14 @@ void nextState() {
 }
 
 /*
-  Set state parameters
+  Set state parameter field (TASK_PARAM_1, TASK_PARAM_2 or TASK_SELECTION)
 */
-void setParameters(byte p1, byte p2, byte s) {
-  param_1 = p1;
-  param_2 = p2;
-  selectedLED = s; 
+void setParameter(byte field, byte value) {
+  switch (field) {
+    case TASK_PARAM_1: param_1 = value; break;
+    case TASK_PARAM_2: param_2 = value; break;
+    case TASK_SELECTION: selectedLED = value; break;
+  }
 }
 
 
@@ -606,24 +849,33 @@ void setup() {
   // start comms
   Serial.begin(BAUD_RATE);
 
-  scheduler = new Scheduler(setState, setParameters);
+  scheduler = new Scheduler(setState, setParameter, ShowProgram, sizeof(ShowProgram));
   state_machine = new StateMachine();
+  telemetry = new Telemetry(fillTelemetry);
+  loadBusAddress();
 
   // Print info when serial monitor connected
+  // blocking flush, the help listing is longer than the log buffer
   printHelp(command_buffer, 0);
+  Log.flush();
   currentState(command_buffer, 0);
   currentColor(command_buffer, 0);
+  Log.flush();
 }
 
 void loop() {
   // handle scheduler
   scheduler->run();
   // handle state
-  state_machine->currentState()->update();
+  state_machine->update();
   // Write current color to LED
   writeLEDColor();
   // Read serial 
   handleSerial();
+  // Binary snapshot when due, before text output
+  telemetry->run();
+  // Write queued output without blocking
+  Log.drain();
   // Handle buttons and pot and emit events on change
   processInput();
 }
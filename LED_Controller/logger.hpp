@@ -0,0 +1,133 @@
+#ifndef LOGGER_HPP
+#define LOGGER_HPP
+
+/*  Buffered Serial output
+
+    Log is a Print that queues output in a
+    ring buffer instead of blocking on Serial.
+    Call drain() every loop iteration to move
+    as much as Serial can take without blocking.
+
+    When the buffer is full the rest of the
+    message (up to the next newline) is dropped
+    and counted. The last free byte is kept for
+    the newline ending a cut message, so the next
+    message starts on its own line.
+
+    Output longer than the buffer is written
+    by a producer, a function called from drain()
+    whenever there is room for one more line.
+
+    Messages have a level, only messages at or
+    below the current verbosity are queued.
+*/
+
+#define LOG_ERROR 0     // errors, always shown
+#define LOG_INFO 1      // command output
+#define LOG_VERBOSE 2   // state changes and debug output
+
+#define LOG_BUFFER_SIZE 192
+#define LOG_LINE_SIZE 96 // free space needed before calling a producer, longest line one writes
+
+/*
+    Discards everything written to it
+*/
+class NullPrint : public Print {
+public:
+  virtual size_t write(uint8_t c) { return 1; };
+};
+
+class Logger : public Print {
+private:
+  uint8_t buffer[LOG_BUFFER_SIZE];
+  byte head = 0;
+  byte tail = 0;
+  bool dropping = false;           // dropping until end of message
+  unsigned int dropped = 0;        // dropped messages
+  bool (*producer)() = NULL;       // returns false when done
+  byte space();
+public:
+  byte level = LOG_INFO;
+  virtual size_t write(uint8_t c);
+  using Print::write;
+  void setProducer(bool (*p)());
+  void drain();
+  void flush();
+  unsigned int droppedMessages() { return dropped; };
+};
+
+Logger Log;
+NullPrint NullLog;
+
+/*
+    True if messages at level are shown
+*/
+bool logEnabled(byte level) {
+  return level <= Log.level;
+}
+
+/*
+    Returns Log for shown levels, else a sink
+*/
+Print &logAt(byte level) {
+  if (logEnabled(level)) return Log;
+  return NullLog;
+}
+
+/*
+    Free bytes in buffer
+*/
+byte Logger::space() {
+  return LOG_BUFFER_SIZE - 1 - (tail + LOG_BUFFER_SIZE - head) % LOG_BUFFER_SIZE;
+}
+
+/*
+    Queue byte, drop the rest of the message if full
+*/
+size_t Logger::write(uint8_t c) {
+  if (dropping) {
+    if (c == '\n') dropping = false;
+    return 1;
+  }
+  byte free_bytes = space();
+  if (free_bytes == 0 || (free_bytes == 1 && c != '\n')) {
+    dropped++;
+    dropping = c != '\n';
+    // end the cut message, unless the buffer ends with a whole one
+    if (free_bytes == 1) c = '\n';
+    else return 1;
+  }
+  buffer[tail] = c;
+  tail = (tail + 1) % LOG_BUFFER_SIZE;
+  return 1;
+}
+
+/*
+    Sets function to produce the rest of a long output,
+    replaces (and counts as dropped) an unfinished one
+*/
+void Logger::setProducer(bool (*p)()) {
+  if (producer) dropped++;
+  producer = p;
+}
+
+/*
+    Write what Serial can take without blocking
+*/
+void Logger::drain() {
+  if (producer && space() >= LOG_LINE_SIZE && !producer()) producer = NULL;
+  int room = Serial.availableForWrite();
+  while (room-- > 0 && head != tail) {
+    Serial.write(buffer[head]);
+    head = (head + 1) % LOG_BUFFER_SIZE;
+  }
+}
+
+/*
+    Blocking write of everything queued, for setup()
+*/
+void Logger::flush() {
+  while (producer || head != tail) drain();
+}
+
+#endif /* ifndef LOGGER_HPP */
@@ -6,269 +6,551 @@
     Arduino Task scheduler
 
     Responsible for running tasks on time.
-    By default running in loop mode, so tasks will be repeated.
+    Tasks are kept on MAX_TRACKS independent tracks,
+    each with its own tasks, position and loop mode.
+    By default tracks are running in loop mode,
+    so tasks will be repeated.
     Call start() to start running the schedler and call run() 
     every loop iteration to function optimally.
 
-    Will not start without tasks
+    Each task starts at the deadline of the one before,
+    not when run() notices it, so tracks don't drift by
+    the loop latency. Time math is unsigned 32 bit, safe
+    over the millis() rollover.
+    sync() moves running tracks to a shared show time,
+    aligning controllers running the same schedule.
+
+    A task sets any of state, param_1, param_2
+    and selection. Each value is taken from the
+    highest numbered running track whose current
+    task sets it, so a brightness track can be
+    layered on top of a state track.
+
+    Tasks are kept packed in the track's store,
+    RAM by default, or EEPROM or a PROGMEM program
+    for programs longer than fits in RAM.
+
+    A track will not start without tasks
 
 */
 
-void printlnBool(bool);
+void printlnBool(Print &out, bool);
+bool printScheduleNext(); // Log producer for printSchedule
+bool printStatusNext();   // Log producer for printStatus
+
+#define MAX_TRACKS 3
+#define CONFIG_EEPROM_BYTES 3 // end of EEPROM, not used for tasks
+#define SOURCES_EEPROM (EEPROM.length() - CONFIG_EEPROM_BYTES) // 2 bits of source per track
+#define MAX_TASKS 512 // index limit, the store space limits the task count
 
 /*
-    Scheduler task
-    run a task for duration, 
-    set state and parameters
-*/
-struct Task {
-  long duration;
-  uint8_t state;
-  uint8_t param_1;
-  uint8_t param_2;
-  uint8_t selection;
-  bool set_params;
+    Tasks run one after another,
+    only the current task is unpacked
+*/
+struct Track {
+    TaskStore store;
+    Task task;                // current task
+    byte task_size = 0;       // packed size of current task
+    int task_offset = 0;      // offset of current task in store
+    int current_task = 0;
+    uint32_t task_start_time = 0; // scheduled start of task, the previous task's deadline
+    bool task_started = false;
+    bool running = false;
+    bool loop = true;
+    bool started = false;     // current task started since last run()
 };
 
-#define MAX_TASKS 30
-
 class Scheduler {
 private:
-    Task tasks[MAX_TASKS]; // Scheduled tasks
-    int task_count = 0;    // Number of tasks in schedule
-    int current_task = 0;
-    long task_start_time = 0; // Time measured when task started
-    bool running = false;
-    bool loop = true;
+    Track tracks[MAX_TRACKS];
+    int8_t applied[TASK_FIELDS]; // track that last set each field, -1 for none
+    int print_track = 0; // next task printed by printNextTask, or track by printNextStatus
+    int print_index = 0;
+    int print_offset = 0;
+    const uint8_t *program;  // PROGMEM program for STORE_PROGMEM
+    int program_length;
     void (*changeToState)(byte state);
-    void (*setParameters)(byte p1, byte p2, byte s);
-    void startTask();
-    void nextTask();
+    void (*setParameter)(byte field, byte value);
+    void nextTask(Track &track);
+    bool loadTask(Track &track);
+    void syncTrack(int track);
+    void useSource(int track, byte source);
+    void printEditError(int track);
+    void applyTasks();
+    byte taskValue(const Task &task, byte field);
 public:
-    // set changeState and setParameter callbacks
-    Scheduler(void (*cts)(byte state), void (*stp)(byte,byte,byte)) : changeToState(cts), setParameters(stp){};
+    // set changeState and setParameter callbacks and the PROGMEM program,
+    // tracks are restored to the sources stored in EEPROM
+    Scheduler(void (*cts)(byte state), void (*stp)(byte field, byte value), const uint8_t *prg, int prg_len) : program(prg), program_length(prg_len), changeToState(cts), setParameter(stp){
+        for (int i = 0; i < TASK_FIELDS; i++) applied[i] = -1;
+        byte sources = EEPROM.read(SOURCES_EEPROM);
+        for (int i = 0; i < MAX_TRACKS; i++) useSource(i, (sources >> (2 * i)) & 0x03);
+    };
     ~Scheduler(){};
     void printSchedule();
+    bool printNextTask();
     void printStatus();
-    void printIndexError(int index);
-    void printTask(int index);
-    void addTask(Task task);
-    void removeTask(int index);
-    void moveTask(int index, int to);
-    void updateTask(int index, Task task);
-    void start();
-    void stop();
-    void enableLoop();
-    void disableLoop();
+    bool printNextStatus();
+    void printIndexError(int track, int index);
+    void printTask(Print &out, int track, int index, const Task &task);
+    void addTask(int track, Task task);
+    void removeTask(int track, int index);
+    void moveTask(int track, int index, int to);
+    void updateTask(int track, int index, Task task);
+    void setSource(int track, byte source);
+    void start(int track);
+    void stop(int track);
+    void enableLoop(int track);
+    void disableLoop(int track);
     bool isRunning();
-    bool isLooping();
+    bool isRunning(int track);
+    bool isLooping(int track);
+    int currentTask(int track);
+    int taskCount(int track);
+    unsigned long taskElapsed(int track);
+    void sync(unsigned long show_time);
     void run();
 };
 
 /*
-    Print order of tasks in schedule
+    Print order of tasks in schedule,
+    tasks are printed by printNextTask as the log drains
 */
 void Scheduler::printSchedule() {
-    Serial.println(F("Schedule:"));
-    if (task_count <= 0) Serial.println(F("\tNo tasks"));
-    for (int i = 0; i < this->task_count; i++) printTask(i);
+    if (!logEnabled(LOG_INFO)) return;
+    Log.println(F("Schedule:"));
+    int count = 0;
+    for (int i = 0; i < MAX_TRACKS; i++) count += taskCount(i);
+    if (count <= 0) Log.println(F("\tNo tasks"));
+    else {
+        print_track = 0;
+        print_index = 0;
+        print_offset = 0;
+        Log.setProducer(printScheduleNext);
+    }
 } 
 
+/*
+    Print the next task of printSchedule, false when done
+*/
+bool Scheduler::printNextTask() {
+    while (print_track < MAX_TRACKS && print_index >= taskCount(print_track)) {
+        print_track++;
+        print_index = 0;
+        print_offset = 0;
+    }
+    if (print_track >= MAX_TRACKS) return false;
+    Task task;
+    print_offset += tracks[print_track].store.readTask(print_offset, &task);
+    printTask(Log, print_track, print_index++, task);
+    return true;
+}
+
 /* 
-    Print status of scheduler and current task
+    Print status of each track and its current task,
+    tracks are printed by printNextStatus as the log drains
 */
 void Scheduler::printStatus() {
-    Serial.println(F("Scheduler:"));
-    Serial.print(F("\tStatus: "));
-    printlnBool(this->isRunning());
-    Serial.print(F("\tLoop: "));
-    printlnBool(this->isLooping());
-    Serial.print(F("\ttc: "));
-    Serial.println(task_count);
-    if (task_count > 0) {
-        printTask(current_task);
-        Serial.print(F("\tFor: "));
-        Serial.print((millis() - task_start_time));
-        Serial.println(F("ms"));
+    if (!logEnabled(LOG_INFO)) return;
+    Log.println(F("Scheduler:"));
+    print_track = 0;
+    Log.setProducer(printStatusNext);
+}
+
+/*
+    Print the next track of printStatus, false when done
+*/
+bool Scheduler::printNextStatus() {
+    if (print_track >= MAX_TRACKS) return false;
+    Print &out = Log;
+    int i = print_track++;
+    TaskStore &store = tracks[i].store;
+    out.print(F("\tTrack "));
+    out.print(i);
+    out.print(F(": "));
+    out.print(isRunning(i) ? F("On") : F("Off"));
+    out.print(F(", Loop: "));
+    out.print(isLooping(i) ? F("On") : F("Off"));
+    out.print(F(", src: "));
+    out.print(store.source());
+    out.print(F(", tc: "));
+    out.print(store.taskCount());
+    out.print(F(", "));
+    out.print(store.bytesUsed());
+    out.print(F("/"));
+    out.print(store.capacity());
+    out.print(F("B"));
+    if (isRunning(i)) {
+        out.print(F(", tsk: "));
+        out.print(tracks[i].current_task);
+        out.print(F(" for "));
+        out.print(taskElapsed(i));
+        out.print(F("ms"));
     }
+    out.println();
+    return true;
 }
 
 /*
     Print task indexing errors
 */
-void Scheduler::printIndexError(int index) {
-    if (index >= task_count) {
-        Serial.print(F("IdxErr: "));
-        Serial.print(index);
-        Serial.print(F("/"));
-        Serial.println(task_count);
+void Scheduler::printIndexError(int track, int index) {
+    if (index >= taskCount(track)) {
+        Log.print(F("IdxErr: "));
+        Log.print(index);
+        Log.print(F("/"));
+        Log.println(taskCount(track));
     }
     if (index < 0) {
-        Serial.print(F("IdxErr: "));
-        Serial.println(index);
+        Log.print(F("IdxErr: "));
+        Log.println(index);
     }
 }
 
+/*
+    Print task value, - if not set by task
+*/
+void printTaskValue(Print &out, const Task &task, byte field, byte value) {
+    if (task.fields & field) out.print(value);
+    else out.print(F("-"));
+}
+
 /*
     Print task info
 */
-void Scheduler::printTask(int index) {
-    Serial.print(F("\tTask: "));
-    Serial.println(index);
-
-    Serial.print(F("\tState_"));
-    Serial.print(tasks[index].state);
-    Serial.print(F(" for "));
-    Serial.print(tasks[index].duration);
-    Serial.print(F("ms, p1: "));
-    Serial.print(tasks[index].param_1);
-    Serial.print(F(", p2: "));
-    Serial.print(tasks[index].param_2);
-    Serial.print(F(", s: "));
-    Serial.println(tasks[index].selection);
+void Scheduler::printTask(Print &out, int track, int index, const Task &task) {
+    out.print(F("\t"));
+    out.print(track);
+    out.print(F(":"));
+    out.print(index);
+    out.print(F(" State_"));
+    printTaskValue(out, task, TASK_STATE, task.state);
+    out.print(F(" for "));
+    out.print(task.duration);
+    out.print(F("ms, p1: "));
+    printTaskValue(out, task, TASK_PARAM_1, task.param_1);
+    out.print(F(", p2: "));
+    printTaskValue(out, task, TASK_PARAM_2, task.param_2);
+    out.print(F(", s: "));
+    printTaskValue(out, task, TASK_SELECTION, task.selection);
+    out.println();
 }
 
 /*
-    Appends task to schedule
+    Print why a store edit failed
 */
-void Scheduler::addTask(Task task) {
-    if (task_count + 1 < MAX_TASKS) tasks[task_count++] = task;
-    else Serial.println(F("TskErr"));
+void Scheduler::printEditError(int track) {
+    if (!tracks[track].store.writable()) Log.println(F("ROErr"));
+    else Log.println(F("TskErr"));
 }
 
 /*
-    Remove task at index from schedule
+    Appends task to track
 */
-void Scheduler::removeTask(int index) {
-    if (index < task_count && index >= 0) {
-        for (int i = index; i < task_count; i++) {
-            tasks[i] = tasks[i + 1];
-        }
-        task_count--;
-    }
-    else printIndexError(index);
+void Scheduler::addTask(int track, Task task) {
+    if (!tracks[track].store.insertTask(taskCount(track), task)) printEditError(track);
+    else syncTrack(track);
 }
 
 /*
-    Move task in schedule 
-*/
-void Scheduler::moveTask(int from, int to) {
-    if (from < task_count && from >= 0 && to < task_count && to >= 0) {
-        int diff = to - from; 
-        bool positive = true;
-        if (diff < 0) {
-            // if diff is negative
-            // set positive to false
-            // make diff positive
-            positive = false;
-            diff = -diff;
-        }
+    Remove task at index from track
+*/
+void Scheduler::removeTask(int track, int index) {
+    if (index < taskCount(track) && index >= 0) {
+        if (!tracks[track].store.removeTask(index)) printEditError(track);
+        else syncTrack(track);
+    }
+    else printIndexError(track, index);
+}
 
-        // swap task until from is in position to  
-        for (int i = 0; i < diff; i++) {
-            int idx1 = from + (positive ? i : -i);
-            int idx2 = idx1 + (positive ? 1 : -1);
-            // swap tasks
-            Task temp = tasks[idx1];
-            tasks[idx1] = tasks[idx2];
-            tasks[idx2] = temp;
-        }
+/*
+    Move task in track,
+    tasks between from and to are shifted one step towards from
+*/
+void Scheduler::moveTask(int track, int from, int to) {
+    if (from < taskCount(track) && from >= 0 && to < taskCount(track) && to >= 0) {
+        if (!tracks[track].store.moveTask(from, to)) printEditError(track);
+        else syncTrack(track);
     } else {
-        printIndexError(from);
-        printIndexError(to);
+        printIndexError(track, from);
+        printIndexError(track, to);
+    }
+}
+
+/*
+    Sets task at index in track to a new task
+*/
+void Scheduler::updateTask(int track, int index, Task task) {
+    if (index < taskCount(track) && index >= 0) {
+        if (!tracks[track].store.updateTask(index, task)) printEditError(track);
+        else syncTrack(track);
     }
+    else printIndexError(track, index);
+}
+
+/*
+    Keeps the current task of a running track valid after an edit,
+    the task keeps its start time
+*/
+void Scheduler::syncTrack(int track) {
+    Track &t = tracks[track];
+    if (!t.running || !t.task_started) return;
+    if (t.current_task >= taskCount(track)) t.current_task = 0;
+    t.task_offset = t.store.offsetOf(t.current_task);
+    if (!loadTask(t)) stop(track);
+}
+
+/*
+    Sets where the tasks of track are kept,
+    STORE_RAM, STORE_EEPROM (its share of the EEPROM before the config bytes)
+    or STORE_PROGMEM (the program given to the scheduler)
+    Stops the track, the source is stored in EEPROM
+    and restored when the scheduler is created
+*/
+void Scheduler::setSource(int track, byte source) {
+    stop(track);
+    useSource(track, source);
+    byte sources = EEPROM.read(SOURCES_EEPROM) & ~(0x03 << (2 * track));
+    EEPROM.update(SOURCES_EEPROM, sources | tracks[track].store.source() << (2 * track));
 }
 
 /*
-    Sets task at index in schedule to a new task
+    Points the track's store at source, anything
+    but EEPROM or PROGMEM (like erased bits) is RAM
 */
-void Scheduler::updateTask(int index, Task task) {
-    if (index < task_count && index >= 0) tasks[index] = task;
-    else printIndexError(index);
+void Scheduler::useSource(int track, byte source) {
+    TaskStore &store = tracks[track].store;
+    if (source == STORE_EEPROM) {
+        int region = (EEPROM.length() - CONFIG_EEPROM_BYTES) / MAX_TRACKS;
+        store.useEEPROM(track * region, region);
+    }
+    else if (source == STORE_PROGMEM) store.useProgram(program, program_length);
+    else store.useRAM();
 }
 
 /*
-    Tries to start schedule
+    Tries to start track
 */
-void Scheduler::start() {
-    if (task_count > 0) this->running = true;
-    else Serial.println(F("No tasks!"));
+void Scheduler::start(int track) {
+    if (taskCount(track) > 0) tracks[track].running = true;
+    else Log.println(F("No tasks!"));
 }
 
 /*
-    Stops the schedule from running
+    Stops the track from running
     and resets current task
 */
-void Scheduler::stop() {
-    this->running = false;
-    this->current_task = 0;
-    this->task_start_time = 0;
+void Scheduler::stop(int track) {
+    tracks[track].running = false;
+    tracks[track].current_task = 0;
+    tracks[track].task_started = false;
 }
 
 
 /*
-    Sets the schedule to repeat after the last task is done
+    Sets the track to repeat after the last task is done
 */
-void Scheduler::enableLoop() {
-    this->loop = true;
+void Scheduler::enableLoop(int track) {
+    tracks[track].loop = true;
 }
 
 /*
-    Sets the schedule to stop when the last task is done
+    Sets the track to stop when the last task is done
 */
-void Scheduler::disableLoop() {
-    this->loop = false;
+void Scheduler::disableLoop(int track) {
+    tracks[track].loop = false;
 }
 
 /*
-    Returns wether or not the schedule is running
+    Returns wether or not any track is running
 */
 bool Scheduler::isRunning() {
-    return this->running;
+    for (int i = 0; i < MAX_TRACKS; i++) {
+        if (tracks[i].running) return true;
+    }
+    return false;
 }
 
 /*
-    True if the scheduler will start again when last task is done
+    Returns wether or not the track is running
 */
-bool Scheduler::isLooping() {
-    return this->loop;
+bool Scheduler::isRunning(int track) {
+    return tracks[track].running;
 }
+
 /*
-  Do all scheduler handling
+    True if the track will start again when last task is done
 */
-void Scheduler::run() {
-    if (!isRunning()) return;
-    if (task_start_time == 0) startTask(); 
-    if (millis() - task_start_time >= tasks[current_task].duration) nextTask();
+bool Scheduler::isLooping(int track) {
+    return tracks[track].loop;
+}
+
+/*
+    Index of the running task in track
+*/
+int Scheduler::currentTask(int track) {
+    return tracks[track].current_task;
+}
+
+/*
+    Number of tasks in track
+*/
+int Scheduler::taskCount(int track) {
+    return tracks[track].store.taskCount();
+}
+
+/*
+    Milliseconds the current task of track has run, 0 when stopped
+*/
+unsigned long Scheduler::taskElapsed(int track) {
+    if (!isRunning(track) || !tracks[track].task_started) return 0;
+    return (uint32_t)millis() - tracks[track].task_start_time;
 }
 
 /*
-    Starts the current task
-    Sets state to task state
-    Sets parameters (if enabled in task)
-    Sets task start time
-*/
-void Scheduler::startTask() {
-    changeToState(tasks[current_task].state);
-    if (tasks[current_task].set_params) setParameters(tasks[current_task].param_1, tasks[current_task].param_2, tasks[current_task].selection);
-    task_start_time = millis();
+  Do all scheduler handling
+  Advances each running track, then applies
+  the values of tasks that started or took over
+*/
+void Scheduler::run() {
+    for (int i = 0; i < MAX_TRACKS; i++) {
+        Track &track = tracks[i];
+        if (!track.running) continue;
+        if (!track.task_started) {
+            track.task_offset = track.store.offsetOf(track.current_task);
+            if (!loadTask(track)) {
+                stop(i);
+                continue;
+            }
+            track.task_start_time = millis();
+            track.task_started = true;
+            track.started = true;
+        }
+        // catch up at most one pass of the track after a stall
+        for (int n = track.store.taskCount(); n > 0 && track.running
+            && (uint32_t)millis() - track.task_start_time >= (uint32_t)track.task.duration; n--) nextTask(track);
+    }
+    applyTasks();
+    for (int i = 0; i < MAX_TRACKS; i++) tracks[i].started = false;
 }
 
 /*
-    Change to next task and start it 
+    Change to next task and start it at the deadline of the current one
     When task-count hit, stop if not looping and set current_task to first task
 */
-void Scheduler::nextTask() {
-    current_task++;
-    if (current_task >= task_count) {
-        current_task = 0;
-        if (!isLooping()) {
-            stop();
-            task_start_time = 0;
+void Scheduler::nextTask(Track &track) {
+    uint32_t deadline = track.task_start_time + track.task.duration;
+    track.current_task++;
+    track.task_offset += track.task_size;
+    if (track.current_task >= track.store.taskCount()) {
+        track.current_task = 0;
+        track.task_offset = 0;
+        if (!track.loop) {
+            track.running = false;
+            track.task_started = false;
             return;
         }
     }
-    startTask();
+    if (loadTask(track)) {
+        track.task_start_time = deadline;
+        track.started = true;
+    }
+    else {
+        track.running = false;
+        track.current_task = 0;
+        track.task_started = false;
+    }
+}
+
+/*
+    Moves running tracks to where they would be show_time ms
+    after they were all started together. Looping tracks wrap
+    around, others stop once past their last task
+*/
+void Scheduler::sync(unsigned long show_time) {
+    uint32_t now = millis();
+    for (int i = 0; i < MAX_TRACKS; i++) {
+        Track &track = tracks[i];
+        if (!track.running) continue;
+        Task task;
+        unsigned long total = 0;
+        int offset = 0;
+        for (int n = 0; n < track.store.taskCount(); n++) {
+            offset += track.store.readTask(offset, &task);
+            total += task.duration;
+        }
+        if (total == 0) continue;
+        unsigned long position = show_time;
+        if (position >= total) {
+            if (!track.loop) {
+                stop(i);
+                continue;
+            }
+            position %= total;
+        }
+        // find the task at position
+        int index = 0;
+        offset = 0;
+        byte task_size = track.store.readTask(offset, &task);
+        while (position >= (unsigned long)task.duration) {
+            position -= task.duration;
+            offset += task_size;
+            index++;
+            task_size = track.store.readTask(offset, &task);
+        }
+        if (index != track.current_task || !track.task_started) track.started = true;
+        track.current_task = index;
+        track.task_offset = offset;
+        loadTask(track);
+        track.task_start_time = now - position;
+        track.task_started = true;
+    }
+}
+
+/*
+    Unpacks the task at the track offset, false if there is none
+*/
+bool Scheduler::loadTask(Track &track) {
+    track.task_size = track.store.readTask(track.task_offset, &track.task);
+    return track.task_size > 0;
+}
+
+/*
+    Task value of field
+*/
+byte Scheduler::taskValue(const Task &task, byte field) {
+    switch (field) {
+        case TASK_STATE: return task.state;
+        case TASK_PARAM_1: return task.param_1;
+        case TASK_PARAM_2: return task.param_2;
+        default: return task.selection;
+    }
+}
+
+/*
+    Sets each field from the highest running track setting it,
+    if that track just started a task or took over the field.
+    State is set first, and parameters are set again after
+    a state change as starting a state may reset them
+*/
+void Scheduler::applyTasks() {
+    bool state_set = false;
+    for (int f = 0; f < TASK_FIELDS; f++) {
+        byte field = 1 << f;
+        int8_t owner = -1;
+        for (int i = MAX_TRACKS - 1; i >= 0 && owner < 0; i--) {
+            if (tracks[i].running && (tracks[i].task.fields & field)) owner = i;
+        }
+        if (owner >= 0 && (owner != applied[f] || tracks[owner].started || state_set)) {
+            byte value = taskValue(tracks[owner].task, field);
+            if (field == TASK_STATE) {
+                changeToState(value);
+                state_set = true;
+            }
+            else setParameter(field, value);
+        }
+        applied[f] = owner;
+    }
 }
 
-#endif /* ifndef SCHEDULER_HPP */
\ No newline at end of file
+#endif /* ifndef SCHEDULER_HPP */
@@ -0,0 +1,32 @@
+#ifndef SHOW_HPP
+#define SHOW_HPP
+
+/*  Scheduler program kept in PROGMEM
+
+    Packed tasks (see taskstore.hpp), run on a
+    track with "schd src <track> 2". Fades red,
+    green and blue up and down, then runs the
+    rainbow for six seconds.
+*/
+
+// Task header, fields with state and selection
+#define SHOW_HEADER(fields, state, selection) ((fields) | (state) << 4 | (selection) << 6)
+// Duration as a two byte varint, up to 16383 ticks
+#define SHOW_DURATION(ms) ((((ms) / TASK_TICK_MS) & 0x7F) | 0x80), (((ms) / TASK_TICK_MS) >> 7)
+
+#define SHOW_STEP(brightness) SHOW_HEADER(TASK_PARAM_1, 0, 0), SHOW_DURATION(60), (brightness)
+#define SHOW_FADE(led) \
+  SHOW_HEADER(TASK_STATE | TASK_SELECTION | TASK_PARAM_1, 0, (led)), SHOW_DURATION(60), 0, \
+  SHOW_STEP(32), SHOW_STEP(64), SHOW_STEP(96), SHOW_STEP(128), \
+  SHOW_STEP(160), SHOW_STEP(192), SHOW_STEP(224), SHOW_STEP(255), \
+  SHOW_STEP(224), SHOW_STEP(192), SHOW_STEP(160), SHOW_STEP(128), \
+  SHOW_STEP(96), SHOW_STEP(64), SHOW_STEP(32)
+
+const uint8_t ShowProgram[] PROGMEM = {
+  SHOW_FADE(0),
+  SHOW_FADE(1),
+  SHOW_FADE(2),
+  SHOW_HEADER(TASK_STATE | TASK_PARAM_1 | TASK_PARAM_2, 1, 0), SHOW_DURATION(6000), 40, 255
+};
+
+#endif /* ifndef SHOW_HPP */
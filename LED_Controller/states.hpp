@@ -26,13 +26,28 @@ byte param_1 = 0;
 byte param_2 = 255;
 long last_update_time = 0;
 
+/*
+    Trace of the last traced UART frame,
+    reported back over UART by UART_State
+    after the LED has been written
+*/
+unsigned int trace_id = 0;
+unsigned long trace_received = 0;
+unsigned long trace_led_written = 0;
+
+/*
+    Number of bad or lost UART messages
+*/
+unsigned int uart_errors = 0;
+
 /*
     External used functions
 */
-void printlnBool(bool);
+void printlnBool(Print &out, bool);
 void printArgumentError();
 void setState(byte);
 void nextState();
+void syncSchedule(unsigned long show_time);
 
 /*
     Callback functions for color and led interactions
@@ -73,7 +88,7 @@ void setSelectedColor(byte intensity) {
 */
 void setSelected(byte led) {
   if (led >= 0 && led < 3) selectedLED = led;
-  else Serial.println(F("LEDErr!"));
+  else Log.println(F("LEDErr!"));
 }
 
 /*
@@ -98,20 +113,20 @@ public:
   virtual void onKey2Released() {}; // Key2 released event
   virtual void onStart() {};        // called when state is set
   virtual void update() {};         // called every loop iteration for the current state 
-  virtual void printInfo() = 0;     // prints state info
+  virtual void printInfo(Print &out) = 0; // prints state info
 
   bool isEnabled() { return this->enabled; };
   void enable() { this->enabled = true; };
   void disable() { this->enabled = false; };
-  void printMode();
+  void printMode(Print &out);
 };
 
 /*
   Prints the mode of the current state, enabled or disabled.
 */
-void State::printMode() {
-  Serial.print(F("\tMode: "));
-  printlnBool(enabled);
+void State::printMode(Print &out) {
+  out.print(F("\tMode: "));
+  printlnBool(out, enabled);
 }
 
 
@@ -127,7 +142,7 @@ public:
   virtual void onKey1Pressed();
   virtual void onKey2Pressed();
   virtual void update();
-  virtual void printInfo();
+  virtual void printInfo(Print &out);
 };
 
 void RGB_State::onKey1Pressed() {
@@ -141,9 +156,9 @@ void RGB_State::update() {
   clearColor();
   setSelectedColor(255);
 }
-void RGB_State::printInfo() {
-  Serial.println(F("\tRGB"));
-  printMode();
+void RGB_State::printInfo(Print &out) {
+  out.println(F("\tRGB"));
+  printMode(out);
 }
 
 /*  Rainbow state
@@ -161,7 +176,7 @@ public:
   ~Rainbow_State(){};
   virtual void onKey2Pressed();
   virtual void update();
-  virtual void printInfo();
+  virtual void printInfo(Print &out);
 };
 
 void Rainbow_State::onKey2Pressed() {
@@ -207,9 +222,9 @@ void Rainbow_State::update() {
   }
 }
 
-void Rainbow_State::printInfo() {
-  Serial.println(F("\tRainbow"));
-  printMode();
+void Rainbow_State::printInfo(Print &out) {
+  out.println(F("\tRainbow"));
+  printMode(out);
 }
 
 /*  ValueControl state
@@ -225,7 +240,7 @@ public:
   virtual void onKey2Pressed();
   virtual void onStart();
   virtual void update();
-  virtual void printInfo();
+  virtual void printInfo(Print &out);
 };
 
 void ValueControl_State::onKey1Pressed() {
@@ -242,27 +257,72 @@ void ValueControl_State::onStart() {
 void ValueControl_State::update() {
     setSelectedColor(param_1);
 }
-void ValueControl_State::printInfo() {
-  Serial.println(F("\tValue Control"));
-  printMode();
+void ValueControl_State::printInfo(Print &out) {
+  out.println(F("\tValue Control"));
+  printMode(out);
 }
 
 #include <SoftwareSerial.h> // For UART state, Arduino to Arduino
 
 #define BAUD_RATE 115200
+#define BUS_TIMEOUT_MS 2 // wait per byte of a frame, a byte takes under 0.1 ms
 #define SOFTWARE_SERIAL_RX 5
 #define SOFTWARE_SERIAL_TX 6
 
+#define SYNC_FRAME 'S'
+#define TRACE_FRAME 'T'
+#define RGB_FRAME 'C'
+#define ADDRESS_FRAME 'A'
+
+/*
+    Bus addresses, the UART can be shared by several controllers
+    0 broadcast, 1 <=> 127 a controller, GROUP_ADDRESS + n group n (0 <=> 7)
+*/
+#define BROADCAST_ADDRESS 0
+#define MAX_BUS_ADDRESS 127
+#define GROUP_ADDRESS 0x80
+
+/*
+    Address and group bits of this controller,
+    address 0 only takes broadcasts
+*/
+byte bus_address = 0;
+byte bus_groups = 0;
+
+/*
+    True if frames sent to address are for this controller
+*/
+bool acceptsAddress(byte address) {
+  if (address == BROADCAST_ADDRESS) return true;
+  if (address & GROUP_ADDRESS) return bus_groups & (1 << (address & 0x07));
+  return address == bus_address;
+}
+
 /*  UART state
     Listens to software serial(UART)
     Sets color value when a (ColorByte)(ValueByte)
     message is sent.
-    Key1 sends events to UART.
+    A ('C')(Red)(Green)(Blue) message sets all colors.
+    A ('S')(Byte3)(Byte2)(Byte1)(Byte0) message syncs
+    the scheduler to the show time in ms (big-endian).
+    A ('T')(TraceHigh)(TraceLow)(ColorByte)(ValueByte)
+    message is answered with ('T')(TraceHigh)(TraceLow)(UsHigh)(UsLow),
+    the microseconds from reading the message to writing the LED.
+    Messages prefixed with ('A')(Address) are only taken
+    if acceptsAddress, others are broadcasts. Traces are
+    answered when sent to bus_address, or broadcast
+    while bus_address is 0, so replies don't collide.
+    The bus is read in every state (StateMachine::update),
+    other states only take sync messages, so a controller
+    playing its schedule stays in step with the show.
+    Key1 sends events to UART, prefixed with ('A')(bus_address)
+    when the address is set.
 */
 
 class UART_State : public State {
 private:
   SoftwareSerial *UART; // Arduino to Arduino serial
+  void sendKey(byte key);
 public:
   UART_State();
   ~UART_State(){};
@@ -271,7 +331,9 @@ public:
   virtual void onKey2Pressed();
   virtual void onStart();
   virtual void update();
-  virtual void printInfo();
+  virtual void printInfo(Print &out);
+  void sendTrace();
+  void readBus(bool colors);
 };
 
 /*
@@ -280,16 +342,27 @@ public:
 UART_State::UART_State() {
   this->UART = new SoftwareSerial(SOFTWARE_SERIAL_RX, SOFTWARE_SERIAL_TX);
   this->UART->begin(BAUD_RATE);
+  this->UART->setTimeout(BUS_TIMEOUT_MS);
+}
+
+/*
+    Send button state to uart
+*/
+void UART_State::sendKey(byte key) {
+  if (bus_address == BROADCAST_ADDRESS) {
+    this->UART->write(&key, 1);
+    return;
+  }
+  byte out[] = {ADDRESS_FRAME, bus_address, key};
+  this->UART->write(out, 3);
 }
 
 void UART_State::onKey1Pressed() {
-  byte out[] = {'1'};
-  this->UART->write(out, 1); // send button state to uart
+  sendKey('1');
 }
 
 void UART_State::onKey1Released() {
-  byte out[] = {'0'};
-  this->UART->write(out, 1); // send button state to uart
+  sendKey('0');
 }
 
 void UART_State::onKey2Pressed() {
@@ -300,37 +373,130 @@ void UART_State::onStart() {
   clearColor();
 }
 
+/*
+    Reports the pending trace
+*/
+void UART_State::sendTrace() {
+  unsigned long led_time = trace_led_written - trace_received;
+  if (led_time > 0xFFFF) led_time = 0xFFFF;
+  byte out[] = {TRACE_FRAME, (byte)(trace_id >> 8), (byte)trace_id, (byte)(led_time >> 8), (byte)led_time};
+  this->UART->write(out, 5);
+  trace_id = 0;
+}
+
+/*
+    Bytes following the frame type, 0 for unknown types
+*/
+byte frameLength(byte type) {
+  switch (type) {
+    case 'R':
+    case 'G':
+    case 'B':
+      return 1;
+    case RGB_FRAME:
+      return 3;
+    case SYNC_FRAME:
+    case TRACE_FRAME:
+      return 4;
+  }
+  return 0;
+}
+
+/*
+    Sets color from a (ColorByte)(ValueByte) pair, false for unknown colors
+*/
+bool setColorValue(byte color, byte value) {
+  switch (color) {
+  case 'R':
+      setSelected(0);
+      break;
+  case 'G':
+      setSelected(1);
+      break;
+  case 'B':
+      setSelected(2);
+      break;
+  default:
+      return false;
+  }
+  setSelectedColor(value);
+  return true;
+}
+
 /*
     Responds to serial commands
 */
 void UART_State::update() {
+  if (trace_id != 0 && trace_led_written != 0) sendTrace();
+  readBus(true);
+  setBrightness(param_1);
+}
+
+/*
+    Reads a frame from the bus when available,
+    color and trace frames are skipped unless colors is set.
+    A frame cut short is dropped after BUS_TIMEOUT_MS
+    and counted as a UART error, so loop() isn't held up
+*/
+void UART_State::readBus(bool colors) {
+  if (this->UART->overflow()) uart_errors++;
   if (this->UART->available()) { // read and process uart input when avaliable
-    byte buffer[2];
-    this->UART->readBytes(buffer, 2);
-    switch (buffer[0]) {
-    case 'R':
-        setSelected(0);
+    unsigned long received = micros();
+    byte address = BROADCAST_ADDRESS;
+    bool addressed = false;
+    byte type = this->UART->read();
+    if (type == ADDRESS_FRAME) {
+      byte header[2];
+      if (this->UART->readBytes(header, 2) < 2) {
+        uart_errors++;
+        return;
+      }
+      address = header[0];
+      type = header[1];
+      addressed = true;
+    }
+    byte frame[4];
+    byte length = frameLength(type);
+    if (length == 0 || this->UART->readBytes(frame, length) < length) {
+      logAt(LOG_VERBOSE).write(type);
+      uart_errors++;
+      return;
+    }
+    // every controller on the bus reads every frame
+    if (!acceptsAddress(address)) return;
+    if (!colors && type != SYNC_FRAME) return;
+    switch (type) {
+    case SYNC_FRAME:
+        syncSchedule((unsigned long)frame[0] << 24 | (unsigned long)frame[1] << 16 | (unsigned long)frame[2] << 8 | frame[3]);
         break;
-    case 'G':
-        setSelected(1);
+    case RGB_FRAME:
+        for (byte i = 0; i < 3; i++) setLEDColor(i, frame[i]);
         break;
-    case 'B':
-        setSelected(2);
+    case TRACE_FRAME:
+        if (!setColorValue(frame[2], frame[3])) {
+          uart_errors++;
+          return;
+        }
+        if (addressed ? address == bus_address : bus_address == BROADCAST_ADDRESS) {
+          trace_received = received;
+          trace_led_written = 0;
+          trace_id = (frame[0] << 8) | frame[1];
+        }
         break;
     default:
-        Serial.write(buffer, 2);
-        return;
-    } 
-    setSelectedColor(buffer[1]);
+        setColorValue(type, frame[0]);
+    }
   }
-  setBrightness(param_1);
 }
 
-void UART_State::printInfo() {
-  Serial.println(F("\tUART"));
-  printMode();
+void UART_State::printInfo(Print &out) {
+  out.println(F("\tUART"));
+  printMode(out);
 }
 
+#define NUM_STATES 4
+#define UART_STATE 3
+
 /*  State machine variables
     Handles states
 */
@@ -338,10 +504,12 @@ void UART_State::printInfo() {
 class StateMachine {
 private:
     byte current_state = 0;
-    State *states[4];
-    byte num_states = 4;
+    State *states[NUM_STATES];
+    UART_State *uart_state;
+    byte num_states = NUM_STATES;
 public:
     StateMachine();
+    void update();
     void setState(byte state);
     void nextState();
     State* currentState();
@@ -354,7 +522,17 @@ StateMachine::StateMachine() {
     states[0] = new RGB_State();
     states[1] = new Rainbow_State();
     states[2] = new ValueControl_State();
-    states[3] = new UART_State();
+    uart_state = new UART_State();
+    states[UART_STATE] = uart_state;
+}
+
+/*
+    Updates the current state, the other
+    states still take sync frames from the bus
+*/
+void StateMachine::update() {
+    states[current_state]->update();
+    if (current_state != UART_STATE) uart_state->readBus(false);
 }
 
 /*
@@ -367,14 +545,17 @@ void StateMachine::setState(byte new_state) {
     if (new_state >= 0 && new_state < num_states) {
         current_state = new_state;
         states[current_state]->onStart();
-        Serial.print(F("State: "));
-        Serial.println(current_state);
+        // scheduler driven, keep quiet unless verbose
+        if (logEnabled(LOG_VERBOSE)) {
+            Log.print(F("State: "));
+            Log.println(current_state);
+        }
     } else {
         printArgumentError();
-        Serial.print(new_state);
-        Serial.print(F(" (0 <> "));
-        Serial.print(num_states);
-        Serial.println(F(")"));
+        Log.print(new_state);
+        Log.print(F(" (0 <> "));
+        Log.print(num_states);
+        Log.println(F(")"));
     }
 }
 
@@ -390,8 +571,9 @@ void StateMachine::nextState() {
         setState(potential);
         return;
         } else {
-            Serial.print(F("State disabled "));
-            Serial.println(potential);}
+            Print &out = logAt(LOG_VERBOSE);
+            out.print(F("State disabled "));
+            out.println(potential);}
     }
 }
 
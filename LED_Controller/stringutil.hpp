@@ -5,9 +5,9 @@
 
     String handling
     
-    Finding numbers in strings
     Getting first non-whitespace
     Finding a substring
+    Tokenizing and parsing command arguments
 */
 
 /*
@@ -34,31 +34,132 @@ int startsWith(const char *string, int str_len, const char *substring) {
 }
 
 /*
-  Returns the position of the first non-numeric character in string, -1 if no numeric character was found
+  Number of rejected commands
 */
-int endOfNumber(const char *string, int str_len) {
-  int start = getStringStart(string, str_len);
-  for (int i = start; i <= str_len; i++) if (string[i] < 48 || string[i] > 57) return i;
-  return -1;
+unsigned int command_errors = 0;
+
+/*
+  Maximum number of arguments to a command
+*/
+#define MAX_ARGUMENTS 7
+
+/*
+  Argument token, a view into the input string
+*/
+struct Token {
+  const char *start;
+  byte length;
+};
+
+/*
+  Splits string on whitespace into tokens in one pass, without modifying it.
+  Returns the number of tokens, or -1 if there are more than max_tokens
+*/
+int tokenize(const char *string, int str_len, Token *tokens, int max_tokens) {
+  int count = 0;
+  int i = 0;
+  while (i < str_len && string[i] != 0) {
+    if (string[i] == ' ' || string[i] == '\t') {
+      i++;
+      continue;
+    }
+    if (count >= max_tokens) return -1;
+    tokens[count].start = string + i;
+    int token_start = i;
+    while (i < str_len && string[i] != 0 && string[i] != ' ' && string[i] != '\t') i++;
+    tokens[count].length = i - token_start;
+    count++;
+  }
+  return count;
 }
 
+/*
+  Parses a decimal token into value.
+  Returns false if the token is not a number or does not fit in a long
+*/
+bool parseLong(Token token, long *value) {
+  int i = 0;
+  bool negative = token.length > 0 && token.start[0] == '-';
+  if (negative) i++;
+  if (i >= token.length) return false;
+  long result = 0;
+  for (; i < token.length; i++) {
+    char c = token.start[i];
+    if (c < '0' || c > '9') return false;
+    if (result > (2147483647L - (c - '0')) / 10) return false;
+    result = result * 10 + (c - '0');
+  }
+  *value = negative ? -result : result;
+  return true;
+}
+
+/*
+  Command argument, accepted range and if it can be left out.
+  Optional arguments can only be followed by optional arguments,
+  a "-" in place of an optional argument leaves it out (SKIPPED_ARGUMENT).
+  Schemas are kept in PROGMEM, the name inline so no string is in RAM.
+*/
+#define SKIPPED_ARGUMENT (-2147483647L - 1)
+#define ARGUMENT_NAME_SIZE 6
+
+struct ArgumentSpec {
+  char name[ARGUMENT_NAME_SIZE];
+  long min;
+  long max;
+  bool optional;
+};
 
 /*
-    Returns number if found, terminates string after number
-    the end int pointer number is increased by the index of the first non numeric.
-    if no number is found, -1 is returned
+  Print argument error, "Err <name>: <token> (<min> <=> <max>)"
 */
-long getNumericArgument(char * input, int len, int *end) {
-  int ns = endOfNumber(input, len);
-  int start = getStringStart(input, len);
-  if (ns-start <= 0) {
-    //Serial.print(F("NErr "));
-    //Serial.println(input);
+void printArgumentSpecError(const ArgumentSpec *spec, const Token *token) {
+  Log.print(F("Err "));
+  Log.print(spec->name);
+  Log.print(F(": "));
+  if (token) Log.write((const uint8_t*)token->start, token->length);
+  else Log.print(F("missing"));
+  Log.print(F(" ("));
+  Log.print(spec->min);
+  Log.print(F(" <=> "));
+  Log.print(spec->max);
+  Log.println(F(")"));
+}
+
+/*
+  Tokenizes input and parses each argument against its spec into values.
+  Returns the number of arguments given (trailing optional ones may be missing),
+  or -1 after printing the error for a missing, unparsable, out of range
+  or unexpected argument. schema is in PROGMEM.
+*/
+int parseArguments(const char *input, int len, const ArgumentSpec *schema, byte schema_len, long *values) {
+  Token tokens[MAX_ARGUMENTS];
+  int count = tokenize(input, len, tokens, MAX_ARGUMENTS);
+  if (count < 0 || count > schema_len) {
+    command_errors++;
+    Log.print(F("Err args: max "));
+    Log.println(schema_len);
     return -1;
-  } 
-  input[ns] = 0;
-  *end += ns+1;
-  return atol(input+start);
+  }
+  for (int i = 0; i < schema_len; i++) {
+    ArgumentSpec spec;
+    memcpy_P(&spec, &schema[i], sizeof(spec));
+    if (i >= count) {
+      if (spec.optional) break;
+      command_errors++;
+      printArgumentSpecError(&spec, NULL);
+      return -1;
+    }
+    if (spec.optional && tokens[i].length == 1 && tokens[i].start[0] == '-') {
+      values[i] = SKIPPED_ARGUMENT;
+      continue;
+    }
+    if (!parseLong(tokens[i], &values[i]) || values[i] < spec.min || values[i] > spec.max) {
+      command_errors++;
+      printArgumentSpecError(&spec, &tokens[i]);
+      return -1;
+    }
+  }
+  return count;
 }
 
 #endif /* indef STRINGUTIL_HPP */
\ No newline at end of file
@@ -0,0 +1,341 @@
+#ifndef TASKSTORE_HPP
+#define TASKSTORE_HPP
+
+/*  Packed scheduler tasks
+
+    Tasks are stored packed, 2 to 7 bytes each:
+      header    bits 0-3 fields, bits 4-5 state, bits 6-7 selection
+      duration  in TASK_TICK_MS ticks, as a varint
+                (7 bits per byte, low bits first,
+                bit 7 set when more bytes follow)
+      param_1   if set by task
+      param_2   if set by task
+
+    A TaskStore holds the packed tasks of one track,
+    either in RAM, in a region of EEPROM or as a
+    read only program in PROGMEM. EEPROM and PROGMEM
+    are read through a small window, so only the task
+    being run is kept in RAM no matter the length
+    of the program.
+*/
+
+/*
+    Values set by a task
+*/
+#define TASK_STATE 0x01
+#define TASK_PARAM_1 0x02
+#define TASK_PARAM_2 0x04
+#define TASK_SELECTION 0x08
+#define TASK_FIELDS 4
+
+/*
+    Scheduler task
+    run a task for duration,
+    set the values in fields
+*/
+struct Task {
+  long duration;
+  uint8_t state;
+  uint8_t param_1;
+  uint8_t param_2;
+  uint8_t selection;
+  uint8_t fields; // TASK_ values set by task
+};
+
+#define TASK_TICK_MS 10       // duration resolution
+#define PACKED_TASK_MAX 7     // header, 4 byte duration, 2 params
+#define MAX_TASK_TICKS (2147483647L / TASK_TICK_MS)
+
+#define STORE_RAM 0
+#define STORE_EEPROM 1
+#define STORE_PROGMEM 2
+
+#define STORE_RAM_BYTES 32    // RAM program per track
+#define STORE_WINDOW 8        // bytes read at a time from EEPROM and PROGMEM
+
+/*
+    Packs task into out, returns the packed size
+*/
+byte packTask(const Task &task, uint8_t *out) {
+  byte length = 0;
+  out[length++] = (task.fields & 0x0F) | (task.state & 0x03) << 4 | (task.selection & 0x03) << 6;
+  // unsigned, durations up to 2^31 - 1 ms would overflow a long when rounding
+  unsigned long ticks = ((unsigned long)task.duration + TASK_TICK_MS / 2) / TASK_TICK_MS;
+  if (ticks > MAX_TASK_TICKS) ticks = MAX_TASK_TICKS;
+  do {
+    out[length] = ticks & 0x7F;
+    ticks >>= 7;
+    if (ticks) out[length] |= 0x80;
+    length++;
+  } while (ticks);
+  if (task.fields & TASK_PARAM_1) out[length++] = task.param_1;
+  if (task.fields & TASK_PARAM_2) out[length++] = task.param_2;
+  return length;
+}
+
+class TaskStore {
+private:
+  uint8_t ram[STORE_RAM_BYTES];
+  int ram_length = 0;
+  uint8_t window[STORE_WINDOW]; // EEPROM or PROGMEM bytes from window_start
+  int window_start = -1;
+  byte type = STORE_RAM;
+  int base = 0;                 // EEPROM region, starts with the length
+  int size = 0;                 // bytes in EEPROM region or program
+  const uint8_t *program = NULL;
+  int length = 0;               // bytes used
+  int count = 0;                // tasks
+  byte readRaw(int offset);
+  void writeRaw(int offset, byte value);
+  void setLength(int new_length);
+  bool replace(int offset, byte old_size, const uint8_t *bytes, byte new_size);
+  void scan();
+public:
+  void useRAM();
+  void useEEPROM(int region_base, int region_size);
+  void useProgram(const uint8_t *program_bytes, int program_length);
+  byte source() { return type; };
+  bool writable() { return type != STORE_PROGMEM; };
+  int capacity();
+  int bytesUsed() { return length; };
+  int taskCount() { return count; };
+  byte read(int offset);
+  int offsetOf(int index);
+  byte readTask(int offset, Task *task);
+  bool insertTask(int index, const Task &task);
+  bool updateTask(int index, const Task &task);
+  bool removeTask(int index);
+  bool moveTask(int from, int to);
+};
+
+/*
+    Byte at offset, without the window
+*/
+byte TaskStore::readRaw(int offset) {
+  switch (type) {
+    case STORE_EEPROM: return EEPROM.read(base + 2 + offset);
+    case STORE_PROGMEM: return pgm_read_byte(program + offset);
+    default: return ram[offset];
+  }
+}
+
+/*
+    Write byte at offset, EEPROM cells are only written if changed
+*/
+void TaskStore::writeRaw(int offset, byte value) {
+  if (type == STORE_EEPROM) EEPROM.update(base + 2 + offset, value);
+  else ram[offset] = value;
+}
+
+/*
+    Sets bytes used, kept in the first two bytes of the EEPROM region
+*/
+void TaskStore::setLength(int new_length) {
+  length = new_length;
+  if (type == STORE_EEPROM) {
+    EEPROM.update(base, length & 0xFF);
+    EEPROM.update(base + 1, length >> 8);
+  }
+  else ram_length = length;
+  window_start = -1;
+}
+
+/*
+    Counts tasks, an EEPROM region not holding
+    whole tasks (like a new EEPROM) is cleared
+*/
+void TaskStore::scan() {
+  Task task;
+  int offset = 0;
+  count = 0;
+  while (offset < length) {
+    byte task_size = readTask(offset, &task);
+    if (task_size == 0) {
+      if (type == STORE_EEPROM) setLength(0);
+      else length = offset;
+      count = 0;
+      return;
+    }
+    offset += task_size;
+    count++;
+  }
+}
+
+/*
+    Keep tasks in RAM
+*/
+void TaskStore::useRAM() {
+  type = STORE_RAM;
+  length = ram_length;
+  window_start = -1;
+  scan();
+}
+
+/*
+    Keep tasks in an EEPROM region, kept over resets
+*/
+void TaskStore::useEEPROM(int region_base, int region_size) {
+  type = STORE_EEPROM;
+  base = region_base;
+  size = region_size;
+  window_start = -1;
+  length = EEPROM.read(base) | EEPROM.read(base + 1) << 8;
+  if (length > capacity()) setLength(0);
+  scan();
+}
+
+/*
+    Run a packed program from PROGMEM, read only
+*/
+void TaskStore::useProgram(const uint8_t *program_bytes, int program_length) {
+  type = STORE_PROGMEM;
+  program = program_bytes;
+  size = program_length;
+  length = program_length;
+  window_start = -1;
+  scan();
+}
+
+/*
+    Bytes available for tasks
+*/
+int TaskStore::capacity() {
+  switch (type) {
+    case STORE_EEPROM: return size - 2;
+    case STORE_PROGMEM: return size;
+    default: return STORE_RAM_BYTES;
+  }
+}
+
+/*
+    Byte at offset, EEPROM and PROGMEM through the window
+*/
+byte TaskStore::read(int offset) {
+  if (type == STORE_RAM) return ram[offset];
+  if (window_start < 0 || offset < window_start || offset >= window_start + STORE_WINDOW) {
+    window_start = offset;
+    for (int i = 0; i < STORE_WINDOW && offset + i < length; i++) window[i] = readRaw(offset + i);
+  }
+  return window[offset - window_start];
+}
+
+/*
+    Offset of task at index, the end if index is task count
+*/
+int TaskStore::offsetOf(int index) {
+  Task task;
+  int offset = 0;
+  for (int i = 0; i < index && offset < length; i++) offset += readTask(offset, &task);
+  return offset;
+}
+
+/*
+    Unpacks task at offset, returns its packed size
+    or 0 at the end or if not a whole task
+*/
+byte TaskStore::readTask(int offset, Task *task) {
+  if (offset >= length) return 0;
+  int i = offset;
+  byte header = read(i++);
+  task->fields = header & 0x0F;
+  task->state = (header >> 4) & 0x03;
+  task->selection = header >> 6;
+  unsigned long ticks = 0;
+  for (byte shift = 0; ; shift += 7) {
+    if (i >= length || shift > 21) return 0;
+    byte b = read(i++);
+    ticks |= (unsigned long)(b & 0x7F) << shift;
+    if (!(b & 0x80)) break;
+  }
+  if (ticks > MAX_TASK_TICKS) return 0;
+  task->duration = ticks * TASK_TICK_MS;
+  task->param_1 = 0;
+  task->param_2 = 0;
+  if (task->fields & TASK_PARAM_1) {
+    if (i >= length) return 0;
+    task->param_1 = read(i++);
+  }
+  if (task->fields & TASK_PARAM_2) {
+    if (i >= length) return 0;
+    task->param_2 = read(i++);
+  }
+  return i - offset;
+}
+
+/*
+    Replaces old_size bytes at offset with new_size bytes,
+    false if read only or out of space
+*/
+bool TaskStore::replace(int offset, byte old_size, const uint8_t *bytes, byte new_size) {
+  if (!writable() || length - old_size + new_size > capacity()) return false;
+  int diff = new_size - old_size;
+  // shift the tail, from the end when growing
+  if (diff > 0) {
+    for (int i = length - 1; i >= offset + old_size; i--) writeRaw(i + diff, readRaw(i));
+  } else if (diff < 0) {
+    for (int i = offset + old_size; i < length; i++) writeRaw(i + diff, readRaw(i));
+  }
+  for (int i = 0; i < new_size; i++) writeRaw(offset + i, bytes[i]);
+  setLength(length + diff);
+  return true;
+}
+
+/*
+    Inserts task before index (at the end if index is task count)
+*/
+bool TaskStore::insertTask(int index, const Task &task) {
+  uint8_t packed[PACKED_TASK_MAX];
+  byte packed_size = packTask(task, packed);
+  if (!replace(offsetOf(index), 0, packed, packed_size)) return false;
+  count++;
+  return true;
+}
+
+/*
+    Sets task at index
+*/
+bool TaskStore::updateTask(int index, const Task &task) {
+  Task old_task;
+  uint8_t packed[PACKED_TASK_MAX];
+  byte packed_size = packTask(task, packed);
+  int offset = offsetOf(index);
+  return replace(offset, readTask(offset, &old_task), packed, packed_size);
+}
+
+/*
+    Removes task at index
+*/
+bool TaskStore::removeTask(int index) {
+  Task task;
+  int offset = offsetOf(index);
+  if (!replace(offset, readTask(offset, &task), NULL, 0)) return false;
+  count--;
+  return true;
+}
+
+/*
+    Moves task at from to index to, rotating the packed
+    bytes in between so each byte is written at most once
+*/
+bool TaskStore::moveTask(int from, int to) {
+  Task task;
+  uint8_t packed[PACKED_TASK_MAX];
+  if (!writable()) return false;
+  int offset = offsetOf(from);
+  byte packed_size = readTask(offset, &task);
+  for (byte i = 0; i < packed_size; i++) packed[i] = readRaw(offset + i);
+  if (from < to) {
+    int end = offsetOf(to + 1);
+    for (int i = offset; i < end - packed_size; i++) writeRaw(i, readRaw(i + packed_size));
+    offset = end - packed_size;
+  } else if (to < from) {
+    int start = offsetOf(to);
+    for (int i = offset + packed_size - 1; i >= start + packed_size; i--) writeRaw(i, readRaw(i - packed_size));
+    offset = start;
+  }
+  for (byte i = 0; i < packed_size; i++) writeRaw(offset + i, packed[i]);
+  window_start = -1;
+  return true;
+}
+
+#endif /* ifndef TASKSTORE_HPP */
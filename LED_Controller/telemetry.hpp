@@ -0,0 +1,106 @@
+#ifndef TELEMETRY_HPP
+#define TELEMETRY_HPP
+
+/*  Binary telemetry snapshots
+
+    Off by default. When a period is set,
+    run() writes a fixed layout snapshot
+    to Serial every period milliseconds.
+
+    Frame:
+      0xA5 0x5A, payload length, payload, CRC-8 of payload
+    Payload is TelemetrySnapshot, little-endian.
+
+    Frames share Serial with text output,
+    readers resync on the header and CRC.
+    A frame is skipped (and counted) rather
+    than blocking when Serial can't take it.
+*/
+
+#define TELEMETRY_MAGIC_1 0xA5
+#define TELEMETRY_MAGIC_2 0x5A
+#define TELEMETRY_VERSION 3
+
+struct __attribute__((packed)) TelemetrySnapshot {
+  uint8_t version;
+  uint8_t sequence;         // increments per frame, gaps are lost frames
+  uint32_t time;            // millis()
+  uint8_t state;
+  uint8_t param_1;
+  uint8_t param_2;
+  uint8_t selected_led;
+  uint8_t rgbb[4];          // red, green, blue, brightness
+  uint8_t scheduler_flags;  // bit n track n running, bit 4+n track n looping
+  uint16_t task[MAX_TRACKS];         // current task index per track
+  uint32_t task_elapsed[MAX_TRACKS]; // ms in current task per track
+  uint16_t log_dropped;     // dropped log messages
+  uint16_t command_errors;  // rejected serial commands
+  uint16_t uart_errors;     // bad or lost UART frames
+  uint16_t skipped;         // skipped telemetry frames
+};
+
+/*
+    CRC-8, polynomial 0x07
+*/
+uint8_t crc8(const uint8_t *data, byte length) {
+  uint8_t crc = 0;
+  for (byte i = 0; i < length; i++) {
+    crc ^= data[i];
+    for (byte b = 0; b < 8; b++) crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+  }
+  return crc;
+}
+
+class Telemetry {
+private:
+  unsigned int period = 0; // ms between snapshots, 0 is off
+  unsigned long last_time = 0;
+  uint8_t sequence = 0;
+  unsigned int skipped = 0;
+  void (*fillSnapshot)(TelemetrySnapshot *snapshot);
+public:
+  // set callback filling in the device values
+  Telemetry(void (*fs)(TelemetrySnapshot*)) : fillSnapshot(fs){};
+  void setPeriod(unsigned int ms);
+  unsigned int getPeriod() { return period; };
+  unsigned int skippedFrames() { return skipped; };
+  void run();
+};
+
+/*
+    Sets ms between snapshots, 0 turns telemetry off
+*/
+void Telemetry::setPeriod(unsigned int ms) {
+  period = ms;
+  last_time = millis();
+}
+
+/*
+    Write a snapshot when due, call every loop iteration
+*/
+void Telemetry::run() {
+  if (period == 0 || millis() - last_time < period) return;
+  last_time += period;
+  // don't fall behind after a stall
+  if (millis() - last_time >= period) last_time = millis();
+
+  uint8_t frame[4 + sizeof(TelemetrySnapshot)];
+  if (Serial.availableForWrite() < (int)sizeof(frame)) {
+    skipped++;
+    return;
+  }
+  TelemetrySnapshot *snapshot = (TelemetrySnapshot*)(frame + 3);
+  fillSnapshot(snapshot);
+  snapshot->version = TELEMETRY_VERSION;
+  snapshot->sequence = sequence++;
+  snapshot->time = millis();
+  snapshot->skipped = skipped;
+
+  frame[0] = TELEMETRY_MAGIC_1;
+  frame[1] = TELEMETRY_MAGIC_2;
+  frame[2] = sizeof(TelemetrySnapshot);
+  frame[3 + sizeof(TelemetrySnapshot)] = crc8(frame + 3, sizeof(TelemetrySnapshot));
+  Serial.write(frame, sizeof(frame));
+}
+
+#endif /* ifndef TELEMETRY_HPP */
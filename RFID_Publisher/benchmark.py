@@ -0,0 +1,69 @@
+#!/usr/bin/env python
+# Card index benchmark: build, reload and lookup latency
+# usage: python3 benchmark.py [entries] [bloom bits per card]
+import os
+import random
+import sys
+import tempfile
+import time
+import cardindex
+
+def percentile(samples, p):
+    return samples[min(len(samples) - 1, int(len(samples) * p))]
+
+def timeLookups(index, ids):
+    samples = []
+    for id in ids:
+        start = time.perf_counter()
+        index.lookup(id)
+        samples.append(time.perf_counter() - start)
+    samples.sort()
+    return samples
+
+def printLatency(name, samples):
+    print("%-10s p50 %6.2fus  p99 %6.2fus  max %7.2fus" % (name,
+        percentile(samples, 0.5) * 1e6, percentile(samples, 0.99) * 1e6, samples[-1] * 1e6))
+
+def run(entries, bloom_bits_per_id, lookups=100000):
+    random.seed(1)
+    # SimpleMFRC522 ids are 5 uid bytes as an integer
+    ids = random.sample(range(1 << 40), entries + lookups)
+    listed = ids[:entries]
+    unlisted = ids[entries:]
+    blacklist = listed[:entries // 10]
+    whitelist = listed[entries // 10:]
+
+    directory = tempfile.mkdtemp()
+    filename = os.path.join(directory, "cards.idx")
+
+    start = time.perf_counter()
+    cardindex.buildIndex(filename, whitelist, blacklist, bloom_bits_per_id)
+    print("Entries:   %d (bloom %d bits/card)" % (entries, bloom_bits_per_id))
+    print("Build:     %.1fms" % ((time.perf_counter() - start) * 1e3))
+    print("File size: %.1fMB" % (os.path.getsize(filename) / 1e6))
+
+    watcher = cardindex.CardIndexWatcher(filename)
+    watcher.verbose = False
+    reloads = []
+    for i in range(20):
+        watcher.reload()
+        reloads.append(watcher.last_reload_time)
+    reloads.sort()
+    print("Reload:    p50 %.3fms  max %.3fms" % (percentile(reloads, 0.5) * 1e3, reloads[-1] * 1e3))
+
+    hits = random.sample(listed, min(lookups, entries))
+    printLatency("Hit", timeLookups(watcher, hits))
+    printLatency("Miss", timeLookups(watcher, unlisted))
+
+    # baseline: the old list scan, on a sample that finishes in reasonable time
+    scan = [str(id) for id in whitelist]
+    samples = timeLookups(type("ListScan", (), {"lookup": lambda self, id: str(id) in scan})(), unlisted[:20])
+    printLatency("List scan", samples)
+
+    os.remove(filename)
+    os.rmdir(directory)
+
+if __name__ == "__main__":
+    entries = int(sys.argv[1]) if len(sys.argv) > 1 else 1000000
+    bloom = int(sys.argv[2]) if len(sys.argv) > 2 else 0
+    run(entries, bloom)
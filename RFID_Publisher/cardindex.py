@@ -0,0 +1,309 @@
+#!/usr/bin/env python
+# Compact on-disk card access index
+#
+# File layout (little-endian):
+#   header  "OELCIDX1", count(u64), bloom_bytes(u32), bloom_k(u32)
+#   bloom   bloom_bytes bytes, optional (bloom_bytes == 0 disables it)
+#   ids     count * u64, sorted
+#   status  count * u8, LISTED_WHITE or LISTED_BLACK
+#
+# The file is memory-mapped and searched with bisect, so lookups
+# touch O(log n) pages and loading does not depend on the list size.
+# Index files are replaced with os.replace() and CardIndexWatcher
+# swaps in the new mapping when inotify reports the rename.
+import bisect
+import ctypes
+import ctypes.util
+import mmap
+import os
+import select
+import struct
+import sys
+import threading
+import time
+
+MAGIC = b"OELCIDX1"
+HEADER = struct.Struct("<8sQII")
+
+UNLISTED = 0
+LISTED_WHITE = 1
+LISTED_BLACK = 2
+
+MASK64 = 0xFFFFFFFFFFFFFFFF
+
+def _mix(x):
+    # splitmix64 finalizer
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9 & MASK64
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EB & MASK64
+    return x ^ (x >> 31)
+
+def _bloom_positions(id, k, bits):
+    h1 = _mix(id)
+    h2 = _mix(h1) | 1
+    return [((h1 + i * h2) & MASK64) % bits for i in range(k)]
+
+def idsFromFile(filename):
+    ids = []
+    with open(filename) as file:
+        for line in file:
+            line = line.rstrip().lstrip()
+            if line == "":
+                continue
+            try:
+                ids.append(int(line))
+            except ValueError:
+                print("Skipping invalid id: " + line)
+    return ids
+
+def buildIndex(filename, whitelist, blacklist, bloom_bits_per_id=0):
+    entries = {}
+    for id in whitelist:
+        entries[id] = LISTED_WHITE
+    # blacklisted cards take precedence, as in on_card_read
+    for id in blacklist:
+        entries[id] = LISTED_BLACK
+    ids = sorted(entries)
+
+    bloom = b""
+    k = 0
+    if bloom_bits_per_id > 0 and len(ids) > 0:
+        bits = max(64, len(ids) * bloom_bits_per_id)
+        bits = (bits + 7) // 8 * 8
+        k = max(1, int(round(bloom_bits_per_id * 0.693)))
+        bloom = bytearray(bits // 8)
+        for id in ids:
+            for p in _bloom_positions(id, k, bits):
+                bloom[p >> 3] |= 1 << (p & 7)
+        bloom = bytes(bloom)
+
+    tmp = filename + ".tmp"
+    with open(tmp, "wb") as file:
+        file.write(HEADER.pack(MAGIC, len(ids), len(bloom), k))
+        file.write(bloom)
+        file.write(struct.pack("<%dQ" % len(ids), *ids))
+        file.write(bytes(entries[id] for id in ids))
+        file.flush()
+        os.fsync(file.fileno())
+    # atomic for readers, CardIndexWatcher sees IN_MOVED_TO
+    os.replace(tmp, filename)
+    return len(ids)
+
+def buildIndexFromLists(filename, whitelist_file, blacklist_file, bloom_bits_per_id=0):
+    whitelist = idsFromFile(whitelist_file) if os.path.exists(whitelist_file) else []
+    blacklist = idsFromFile(blacklist_file) if os.path.exists(blacklist_file) else []
+    return buildIndex(filename, whitelist, blacklist, bloom_bits_per_id)
+
+class _U64View:
+    # Fallback sequence for big-endian hosts where memoryview.cast can't be used
+    def __init__(self, buffer, offset, count):
+        self.buffer = buffer
+        self.offset = offset
+        self.count = count
+
+    def __len__(self):
+        return self.count
+
+    def __getitem__(self, i):
+        return struct.unpack_from("<Q", self.buffer, self.offset + i * 8)[0]
+
+class CardIndex:
+    def __init__(self, filename):
+        with open(filename, "rb") as file:
+            size = os.fstat(file.fileno()).st_size
+            if size < HEADER.size:
+                raise ValueError("Index too short: " + filename)
+            self.map = mmap.mmap(file.fileno(), 0, access=mmap.ACCESS_READ)
+        magic, self.count, bloom_bytes, self.bloom_k = HEADER.unpack_from(self.map, 0)
+        if magic != MAGIC:
+            raise ValueError("Not a card index: " + filename)
+        ids_offset = HEADER.size + bloom_bytes
+        status_offset = ids_offset + self.count * 8
+        if status_offset + self.count > size:
+            raise ValueError("Truncated card index: " + filename)
+
+        buffer = memoryview(self.map)
+        self.bloom = buffer[HEADER.size:ids_offset]
+        self.bloom_bits = bloom_bytes * 8
+        if sys.byteorder == "little":
+            self.ids = buffer[ids_offset:status_offset].cast("Q")
+        else:
+            self.ids = _U64View(self.map, ids_offset, self.count)
+        self.status = buffer[status_offset:status_offset + self.count]
+
+    def __len__(self):
+        return self.count
+
+    def mightContain(self, id):
+        if self.bloom_bits == 0:
+            return True
+        for p in _bloom_positions(id, self.bloom_k, self.bloom_bits):
+            if not self.bloom[p >> 3] & (1 << (p & 7)):
+                return False
+        return True
+
+    def lookup(self, id):
+        id = int(id)
+        if id < 0 or id > MASK64 or not self.mightContain(id):
+            return UNLISTED
+        i = bisect.bisect_left(self.ids, id)
+        if i < self.count and self.ids[i] == id:
+            return self.status[i]
+        return UNLISTED
+
+# inotify(7) constants
+IN_CLOSE_WRITE = 0x00000008
+IN_MOVED_TO = 0x00000080
+IN_CREATE = 0x00000100
+INOTIFY_EVENT = struct.Struct("iIII")
+# seconds the watcher waits for events before checking if it was stopped
+WATCH_TIMEOUT = 0.5
+
+def _inotify():
+    if not sys.platform.startswith("linux"):
+        return None
+    libc = ctypes.CDLL(ctypes.util.find_library("c"), use_errno=True)
+    if not hasattr(libc, "inotify_init"):
+        return None
+    return libc
+
+class CardIndexWatcher:
+    # Holds the current CardIndex and swaps it when the index file is replaced.
+    # If whitelist/blacklist text files are given, edits to them rebuild the index.
+    def __init__(self, index_file, whitelist_file=None, blacklist_file=None, bloom_bits_per_id=0):
+        self.index_file = os.path.abspath(index_file)
+        self.whitelist_file = whitelist_file
+        self.blacklist_file = blacklist_file
+        self.bloom_bits_per_id = bloom_bits_per_id
+        self.reload_count = 0
+        self.last_reload_time = 0.0
+        self.running = False
+        self.thread = None
+        self.verbose = True
+        if self._hasLists() and self._listsNewer():
+            self._rebuild()
+        self.current = CardIndex(self.index_file)
+
+    def _hasLists(self):
+        return self.whitelist_file is not None or self.blacklist_file is not None
+
+    def _listsNewer(self):
+        if not os.path.exists(self.index_file):
+            return True
+        index_time = os.path.getmtime(self.index_file)
+        for f in (self.whitelist_file, self.blacklist_file):
+            if f is not None and os.path.exists(f) and os.path.getmtime(f) > index_time:
+                return True
+        return False
+
+    def _rebuild(self):
+        count = buildIndexFromLists(self.index_file, self.whitelist_file or "", self.blacklist_file or "", self.bloom_bits_per_id)
+        print("Index rebuilt: " + str(count) + " cards")
+
+    def lookup(self, id):
+        # take one reference so a concurrent swap can't split the lookup
+        return self.current.lookup(id)
+
+    def reload(self):
+        start = time.perf_counter()
+        try:
+            index = CardIndex(self.index_file)
+        except (OSError, ValueError) as e:
+            print("Index reload failed: " + str(e))
+            return False
+        self.current = index
+        self.last_reload_time = time.perf_counter() - start
+        self.reload_count += 1
+        if self.verbose:
+            print("Index reloaded: " + str(len(index)) + " cards")
+        return True
+
+    def _onChange(self, name):
+        if name == os.path.basename(self.index_file):
+            self.reload()
+        elif name in self._listNames():
+            try:
+                self._rebuild()
+            except OSError as e:
+                print("Index rebuild failed: " + str(e))
+
+    def _listNames(self):
+        return [os.path.basename(f) for f in (self.whitelist_file, self.blacklist_file) if f is not None]
+
+    def start(self):
+        self.running = True
+        libc = _inotify()
+        target = self._watchInotify if libc is not None else self._watchPoll
+        self.thread = threading.Thread(target=target, args=(libc,) if libc else (), daemon=True)
+        self.thread.start()
+
+    def stop(self):
+        self.running = False
+        if self.thread is not None:
+            self.thread.join(WATCH_TIMEOUT * 2)
+
+    def _watchInotify(self, libc):
+        fd = libc.inotify_init()
+        if fd < 0:
+            self._watchPoll()
+            return
+        directory = os.path.dirname(self.index_file).encode()
+        if libc.inotify_add_watch(fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0:
+            os.close(fd)
+            self._watchPoll()
+            return
+        try:
+            while self.running:
+                # wait with a timeout so stop() ends the thread
+                readable, _, _ = select.select([fd], [], [], WATCH_TIMEOUT)
+                if not readable:
+                    continue
+                data = os.read(fd, 4096)
+                pos = 0
+                while pos < len(data):
+                    wd, mask, cookie, length = INOTIFY_EVENT.unpack_from(data, pos)
+                    pos += INOTIFY_EVENT.size
+                    name = data[pos:pos + length].rstrip(b"\0").decode()
+                    pos += length
+                    # IN_CREATE alone is a file still being written
+                    if mask & (IN_CLOSE_WRITE | IN_MOVED_TO):
+                        self._onChange(name)
+        finally:
+            os.close(fd)
+
+    def _watchPoll(self, interval=1.0):
+        files = [self.index_file] + [f for f in (self.whitelist_file, self.blacklist_file) if f is not None]
+        times = {f: self._mtime(f) for f in files}
+        while self.running:
+            time.sleep(interval)
+            for f in files:
+                t = self._mtime(f)
+                if t != times[f]:
+                    times[f] = t
+                    self._onChange(os.path.basename(f))
+
+    def _mtime(self, filename):
+        try:
+            return os.stat(filename).st_mtime_ns
+        except OSError:
+            return 0
+
+if __name__ == "__main__":
+    import argparse
+    parser = argparse.ArgumentParser(description="Build or query a card access index")
+    sub = parser.add_subparsers(dest="command", required=True)
+    build = sub.add_parser("build")
+    build.add_argument("index")
+    build.add_argument("--whitelist", default="whitelist")
+    build.add_argument("--blacklist", default="blacklist")
+    build.add_argument("--bloom", type=int, default=0, help="bloom filter bits per card, 0 disables")
+    query = sub.add_parser("query")
+    query.add_argument("index")
+    query.add_argument("id", type=int)
+    args = parser.parse_args()
+
+    if args.command == "build":
+        count = buildIndexFromLists(args.index, args.whitelist, args.blacklist, args.bloom)
+        print(str(count) + " cards written to " + args.index)
+    else:
+        status = CardIndex(args.index).lookup(args.id)
+        print(["unlisted", "whitelisted", "blacklisted"][status])
@@ -1,18 +1,38 @@
 #!/usr/bin/env python
-import paho.mqtt.client as mqttClient
+import os
+import time
+from mqttclient import newClient
 
 broker = "localhost"
 port = 1883
-mqtt_c = mqttClient.Client("rfid_publisher")
+mqtt_c = newClient("rfid_publisher")
 mqtt_connected = False
 
+# Latency tracing, see tracer.py
+trace_enabled = os.environ.get("OELC_TRACE") == "1"
+last_trace = 0
+
+def new_trace():
+    # returns a trace id (1 <=> 65535) and records the start time, None when tracing is off
+    if not trace_enabled:
+        return None
+    global last_trace
+    last_trace = last_trace % 65535 + 1
+    mqtt_c.publish("trace/pub", str(last_trace) + " " + repr(time.time()))
+    return last_trace
+
+def traced(payload, trace):
+    if trace is None:
+        return payload
+    return payload + ";" + str(trace)
+
 def clear_level():
     mqtt_c.publish("LED/R", "0")
     mqtt_c.publish("LED/G", "0")
     mqtt_c.publish("LED/B", "0")
     print("clr")
 
-def on_broker_connected(client, userdata, flags, rc):
+def on_broker_connected(client, userdata, flags, rc, properties=None):
     if rc == 0:
         print("Connected to broker")
         global mqtt_connected
@@ -20,23 +40,23 @@ def on_broker_connected(client, userdata, flags, rc):
     else:
         print("Failed to connect to broker")
 
-def on_level_0():
+def on_level_0(trace=None):
     clear_level()
-    mqtt_c.publish("LED/R", "255")
+    mqtt_c.publish("LED/R", traced("255", trace))
     print("l0")
 
-def on_level_1():
+def on_level_1(trace=None):
     clear_level()
-    mqtt_c.publish("LED/B", "255")
+    mqtt_c.publish("LED/B", traced("255", trace))
     print("l1")
 
-def on_level_2():  
+def on_level_2(trace=None):  
     clear_level()
-    mqtt_c.publish("LED/G", "255")
+    mqtt_c.publish("LED/G", traced("255", trace))
     print("l2")
 
-def publish_id(id):
-    mqtt_c.publish("local/rfid/id", id)
+def publish_id(id, trace=None):
+    mqtt_c.publish("local/rfid/id", traced(str(id), trace))
 
 def start():
     mqtt_c.on_connected = on_broker_connected
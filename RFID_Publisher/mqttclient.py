@@ -0,0 +1,10 @@
+#!/usr/bin/env python
+# paho-mqtt client construction shared by the publisher, tracer
+# and the simulation load tests
+import paho.mqtt.client as mqttClient
+
+def newClient(name):
+    # paho-mqtt 2 requires the callback API version
+    if hasattr(mqttClient, "CallbackAPIVersion"):
+        return mqttClient.Client(mqttClient.CallbackAPIVersion.VERSION2, client_id=name)
+    return mqttClient.Client(client_id=name)
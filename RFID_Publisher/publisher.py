@@ -3,47 +3,41 @@ import pathlib
 import time
 import rfid
 import mqtt
+import cardindex
 
 relative_path = str(pathlib.Path(__file__).parent.resolve()) + "/"
 
-def arrayFromFile(filename):
-    array = []
-    with open(filename) as file:
-        for line in file:
-            line = line.rstrip().lstrip()
-            if line != "":
-                array.append(line)
-    return array
-
-whitelist = []
-blacklist = []
+cards = None
 
 def on_card_read(id, text):
+    trace = mqtt.new_trace()
     print(id)
-    if str(id) in blacklist:
-        on_blacklisted_card(id, text)
-    elif str(id) in whitelist:
-        on_whitelisted_card(id, text)
+    status = cards.lookup(id)
+    if status == cardindex.LISTED_BLACK:
+        on_blacklisted_card(id, text, trace)
+    elif status == cardindex.LISTED_WHITE:
+        on_whitelisted_card(id, text, trace)
     else:
-        on_unlisted_card(id, text)
+        on_unlisted_card(id, text, trace)
     time.sleep(3)
     mqtt.clear_level()
 
-def on_whitelisted_card(id, text):
-    mqtt.on_level_2()
+def on_whitelisted_card(id, text, trace=None):
+    mqtt.on_level_2(trace)
 
-def on_blacklisted_card(id, text):
-    mqtt.on_level_0()
+def on_blacklisted_card(id, text, trace=None):
+    mqtt.on_level_0(trace)
 
-def on_unlisted_card(id, text):
-    mqtt.publish_id(id)
-    mqtt.on_level_1()
+def on_unlisted_card(id, text, trace=None):
+    mqtt.publish_id(id, trace)
+    mqtt.on_level_1(trace)
 
 if __name__ == '__main__': 
     mqtt.start()
     try:
-        whitelist = arrayFromFile(relative_path + "whitelist")
-        blacklist = arrayFromFile(relative_path + "blacklist")
+        # rebuilt from whitelist/blacklist when they change, reloaded without restart
+        cards = cardindex.CardIndexWatcher(relative_path + "cards.idx", relative_path + "whitelist", relative_path + "blacklist")
+        cards.start()
 
         print("Starting reader")
         while True:
@@ -0,0 +1,123 @@
+#!/usr/bin/env python
+# Latency trace collector
+#
+# Subscribes to the trace topics and reassembles card read -> LED latency:
+#   trace/pub  "<id> <host time s>"            published by mqtt.new_trace()
+#   trace/gw   "<id> <rx us> <tx us>"          gateway received and forwarded the color
+#   trace/ctl  "<id> <ack rx us> <led us>"     gateway received the controller report,
+#                                              led us is controller frame read -> LED write
+# Gateway times are on the gateway clock, so the broker and UART legs are
+# round trips halved; host and gateway processing times are exact.
+#
+# usage: python3 tracer.py [--broker host] [--inject count --interval s]
+# --inject publishes traced LED/G messages itself, for the host simulation
+# or when no card reader is attached.
+import argparse
+import threading
+import time
+from mqttclient import newClient
+
+US32 = 0xFFFFFFFF
+HOPS = ["broker", "gateway", "uart", "controller", "total"]
+
+class Trace:
+    def __init__(self, id):
+        self.id = id
+        self.pub_time = None
+        self.gw_host_time = None
+        self.gw = None
+        self.ctl = None
+
+    def complete(self):
+        return self.pub_time is not None and self.gw is not None and self.ctl is not None
+
+    def breakdown(self):
+        # microseconds per hop
+        gw_rx, gw_tx = self.gw
+        ack_rx, led = self.ctl
+        gateway = (gw_tx - gw_rx) & US32
+        broker = max(0, ((self.gw_host_time - self.pub_time) * 1e6 - gateway) / 2)
+        uart = max(0, (((ack_rx - gw_tx) & US32) - led) / 2)
+        return {"broker": broker, "gateway": gateway, "uart": uart, "controller": led,
+                "total": broker + gateway + uart + led}
+
+class Collector:
+    def __init__(self, quiet=False):
+        self.traces = {}
+        self.results = []
+        self.quiet = quiet
+        self.lock = threading.Lock()
+
+    def onMessage(self, client, userdata, message):
+        now = time.time()
+        fields = message.payload.decode().split()
+        if len(fields) < 2:
+            return
+        id = int(fields[0])
+        with self.lock:
+            trace = self.traces.setdefault(id, Trace(id))
+            if message.topic == "trace/pub":
+                # a reused id starts a new trace
+                if trace.pub_time is not None:
+                    trace = self.traces[id] = Trace(id)
+                trace.pub_time = float(fields[1])
+            elif message.topic == "trace/gw" and len(fields) == 3:
+                trace.gw_host_time = now
+                trace.gw = (int(fields[1]), int(fields[2]))
+            elif message.topic == "trace/ctl" and len(fields) == 3:
+                trace.ctl = (int(fields[1]), int(fields[2]))
+            if trace.complete():
+                del self.traces[id]
+                self.report(trace)
+
+    def report(self, trace):
+        hops = trace.breakdown()
+        self.results.append(hops)
+        if not self.quiet:
+            print("%5d " % trace.id + "  ".join("%s %.0fus" % (hop, hops[hop]) for hop in HOPS))
+
+    def summary(self):
+        print("Traces: %d complete, %d incomplete" % (len(self.results), len(self.traces)))
+        if len(self.results) == 0:
+            return
+        print("%-10s %10s %10s %10s" % ("hop", "p50 us", "p90 us", "p99 us"))
+        for hop in HOPS:
+            samples = sorted(result[hop] for result in self.results)
+            p = lambda q: samples[min(len(samples) - 1, int(len(samples) * q))]
+            print("%-10s %10.0f %10.0f %10.0f" % (hop, p(0.5), p(0.9), p(0.99)))
+
+def inject(client, count, interval):
+    for i in range(count):
+        id = i % 65535 + 1
+        client.publish("trace/pub", str(id) + " " + repr(time.time()))
+        client.publish("LED/G", str(i % 256) + ";" + str(id))
+        time.sleep(interval)
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Collect end to end latency traces")
+    parser.add_argument("--broker", default="localhost")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--inject", type=int, default=0, help="publish this many traced colors")
+    parser.add_argument("--interval", type=float, default=0.2)
+    parser.add_argument("--quiet", action="store_true")
+    args = parser.parse_args()
+
+    collector = Collector(args.quiet)
+    client = newClient("trace_collector")
+    client.on_message = collector.onMessage
+    client.connect(args.broker, args.port)
+    client.subscribe("trace/#")
+    client.loop_start()
+    try:
+        if args.inject > 0:
+            inject(client, args.inject, args.interval)
+            # let the last reports arrive
+            time.sleep(1)
+        else:
+            while True:
+                time.sleep(1)
+    except KeyboardInterrupt:
+        pass
+    client.loop_stop()
+    client.disconnect()
+    collector.summary()
@@ -0,0 +1,193 @@
+#include "Arduino.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+/*  Host simulation of the Arduino core
+    See Arduino.h
+*/
+
+HardwareSerial Serial;
+
+#define NUM_PINS 20
+
+static int pin_values[NUM_PINS];
+static FILE *pwm_log = NULL;
+static struct timespec boot_time;
+static unsigned long long clock_offset = 0; // ns, from OELC_MILLIS
+
+/*
+    Nanoseconds since boot
+*/
+static unsigned long long uptime() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - boot_time.tv_sec) * 1000000000ULL + now.tv_nsec - boot_time.tv_nsec + clock_offset;
+}
+
+// unsigned long is 64 bits on the host, wrap like the AVR 32 bit counters
+unsigned long millis() {
+    return (uint32_t)(uptime() / 1000000ULL);
+}
+
+unsigned long micros() {
+    return (uint32_t)(uptime() / 1000ULL);
+}
+
+void delay(unsigned long ms) {
+    usleep(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+    usleep(us);
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+
+int digitalRead(uint8_t pin) {
+    return pin < NUM_PINS ? pin_values[pin] : LOW;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    if (pin < NUM_PINS) pin_values[pin] = value;
+}
+
+int analogRead(uint8_t pin) {
+    const char *pot = getenv("OELC_POT");
+    return pot ? atoi(pot) : 1023;
+}
+
+/*
+    Logs PWM changes as "<host time s> <pin> <value>",
+    wall clock so host tools can compare against their own times
+*/
+void analogWrite(uint8_t pin, int value) {
+    if (pin >= NUM_PINS || pin_values[pin] == value) return;
+    pin_values[pin] = value;
+    if (pwm_log) {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        fprintf(pwm_log, "%ld.%06ld %u %d\n", (long)now.tv_sec, now.tv_nsec / 1000, pin, value);
+        fflush(pwm_log);
+    }
+}
+
+long map(long x, long in_min, long in_max, long out_min, long out_max) {
+    return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+int digitalPinToInterrupt(uint8_t pin) {
+    return pin;
+}
+
+void attachInterrupt(int interrupt, void (*isr)(), int mode) {}
+
+//
+// Print and Stream
+//
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+    size_t n = 0;
+    while (size--) n += write(*buffer++);
+    return n;
+}
+
+size_t Print::printNumber(unsigned long n, int base) {
+    char buffer[8 * sizeof(long) + 1];
+    char *string = &buffer[sizeof(buffer) - 1];
+    *string = 0;
+    do {
+        char c = n % base;
+        n /= base;
+        *--string = c < 10 ? c + '0' : c + 'A' - 10;
+    } while (n);
+    return write(string);
+}
+
+size_t Print::print(long n, int base) {
+    if (n < 0 && base == DEC) return print('-') + printNumber(-n, base);
+    return printNumber(n, base);
+}
+
+size_t Print::print(double n, int digits) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.*f", digits, n);
+    return write(buffer);
+}
+
+int Stream::timedRead() {
+    unsigned long start = millis();
+    do {
+        int c = read();
+        if (c >= 0) return c;
+        usleep(50);
+    } while (millis() - start < timeout);
+    return -1;
+}
+
+size_t Stream::readBytes(char *buffer, size_t length) {
+    size_t count = 0;
+    while (count < length) {
+        int c = timedRead();
+        if (c < 0) break;
+        *buffer++ = (char)c;
+        count++;
+    }
+    return count;
+}
+
+//
+// Serial
+//
+
+void HardwareSerial::begin(unsigned long baud) {
+    fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+}
+
+int HardwareSerial::available() {
+    return peek() >= 0 ? 1 : 0;
+}
+
+int HardwareSerial::read() {
+    int c = peek();
+    peeked = -1;
+    return c;
+}
+
+int HardwareSerial::peek() {
+    if (peeked < 0) {
+        unsigned char c;
+        if (::read(STDIN_FILENO, &c, 1) == 1) peeked = c;
+    }
+    return peeked;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+    return fwrite(&c, 1, 1, stdout);
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+    return fwrite(buffer, 1, size, stdout);
+}
+
+//
+// Arduino main
+//
+
+int main() {
+    clock_gettime(CLOCK_MONOTONIC, &boot_time);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    const char *pwm_log_path = getenv("OELC_PWM_LOG");
+    if (pwm_log_path) pwm_log = fopen(pwm_log_path, "a");
+    const char *start_millis = getenv("OELC_MILLIS");
+    if (start_millis) clock_offset = strtoull(start_millis, NULL, 10) * 1000000ULL;
+
+    setup();
+    for (;;) {
+        loop();
+        // keep an idle simulation from spinning a core
+        usleep(20);
+    }
+}
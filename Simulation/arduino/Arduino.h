@@ -0,0 +1,136 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+/*  Host simulation of the Arduino core
+
+    Just enough of the Arduino API for the
+    LED_Controller and ETOU_Gateway sketches
+    to be built and run natively.
+
+    Serial is mapped to stdin/stdout,
+    time is taken from the monotonic clock and
+    pins are kept in memory.
+
+    analogWrite changes are appended to the
+    file named by OELC_PWM_LOG if it is set,
+    as "<host time s> <pin> <value>".
+    analogRead returns OELC_POT (default 1023).
+    millis() starts at OELC_MILLIS (default 0),
+    to test the rollover of the 32 bit counters.
+    EEPROM is kept in the file named by OELC_EEPROM
+    if it is set (see EEPROM.h).
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+#define BIN 2
+#define DEC 10
+#define HEX 16
+#define A0 14
+
+// Strings and PROGMEM data stay in RAM on the host
+#define F(string) (string)
+#define PROGMEM
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+#define memcpy_P memcpy
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t value);
+int analogRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+long map(long x, long in_min, long in_max, long out_min, long out_max);
+
+int digitalPinToInterrupt(uint8_t pin);
+void attachInterrupt(int interrupt, void (*isr)(), int mode);
+
+/*
+    Arduino Print, number formatting and println
+*/
+class Print {
+private:
+    size_t printNumber(unsigned long n, int base);
+public:
+    virtual ~Print(){};
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size);
+    size_t write(const char *string) { return write((const uint8_t*)string, strlen(string)); };
+
+    size_t print(const char *string) { return write(string); };
+    size_t print(char c) { return write((uint8_t)c); };
+    size_t print(unsigned char n, int base = DEC) { return print((unsigned long)n, base); };
+    size_t print(int n, int base = DEC) { return print((long)n, base); };
+    size_t print(unsigned int n, int base = DEC) { return print((unsigned long)n, base); };
+    size_t print(long n, int base = DEC);
+    size_t print(unsigned long n, int base = DEC) { return printNumber(n, base); };
+    size_t print(double n, int digits = 2);
+
+    size_t println() { return write("\r\n"); };
+    template <typename T> size_t println(T value) { size_t n = print(value); return n + println(); };
+    template <typename T> size_t println(T value, int format) { size_t n = print(value, format); return n + println(); };
+};
+
+/*
+    Arduino Stream, reads with timeout
+*/
+class Stream : public Print {
+protected:
+    unsigned long timeout = 1000;
+    int timedRead();
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    void setTimeout(unsigned long ms) { timeout = ms; };
+    size_t readBytes(char *buffer, size_t length);
+    size_t readBytes(uint8_t *buffer, size_t length) { return readBytes((char*)buffer, length); };
+};
+
+/*
+    Serial on the process stdin and stdout,
+    stdout never blocks so the tx buffer is always empty
+*/
+#define SERIAL_TX_BUFFER_SIZE 64
+
+class HardwareSerial : public Stream {
+private:
+    int peeked = -1;
+public:
+    void begin(unsigned long baud);
+    virtual int available();
+    virtual int read();
+    virtual int peek();
+    int availableForWrite() { return SERIAL_TX_BUFFER_SIZE - 1; };
+    virtual size_t write(uint8_t c);
+    virtual size_t write(const uint8_t *buffer, size_t size);
+    using Print::write;
+    operator bool() { return true; };
+};
+
+extern HardwareSerial Serial;
+
+// Implemented by the sketch
+void setup();
+void loop();
+
+#endif /* ifndef ARDUINO_H */
@@ -0,0 +1,47 @@
+#include "EEPROM.h"
+
+/*  Host simulation of the Arduino EEPROM library
+    See EEPROM.h
+*/
+
+EEPROMClass EEPROM;
+
+/*
+    Erase, then read the backing file if there is one
+*/
+void EEPROMClass::load() {
+    loaded = true;
+    memset(cells, 0xFF, sizeof(cells));
+    const char *path = getenv("OELC_EEPROM");
+    if (!path) return;
+    file = fopen(path, "r+b");
+    if (!file) file = fopen(path, "w+b");
+    if (!file) return;
+    size_t size = fread(cells, 1, sizeof(cells), file);
+    // a new file is filled with erased cells
+    if (size < sizeof(cells)) {
+        fseek(file, 0, SEEK_SET);
+        fwrite(cells, 1, sizeof(cells), file);
+        fflush(file);
+    }
+}
+
+uint8_t EEPROMClass::read(int address) {
+    if (!loaded) load();
+    return address >= 0 && address < EEPROM_SIZE ? cells[address] : 0xFF;
+}
+
+void EEPROMClass::write(int address, uint8_t value) {
+    if (!loaded) load();
+    if (address < 0 || address >= EEPROM_SIZE) return;
+    cells[address] = value;
+    if (file) {
+        fseek(file, address, SEEK_SET);
+        fputc(value, file);
+        fflush(file);
+    }
+}
+
+void EEPROMClass::update(int address, uint8_t value) {
+    if (read(address) != value) write(address, value);
+}
@@ -0,0 +1,31 @@
+#ifndef EEPROM_H
+#define EEPROM_H
+
+/*  Host simulation of the Arduino EEPROM library
+
+    1 KB like the UNO, erased (0xFF) on start.
+    If OELC_EEPROM names a file it is loaded
+    from and written through to that file,
+    so contents are kept between runs.
+*/
+
+#include "Arduino.h"
+
+#define EEPROM_SIZE 1024
+
+class EEPROMClass {
+private:
+    uint8_t cells[EEPROM_SIZE];
+    FILE *file = NULL;
+    bool loaded = false;
+    void load();
+public:
+    uint8_t read(int address);
+    void write(int address, uint8_t value);
+    void update(int address, uint8_t value);
+    uint16_t length() { return EEPROM_SIZE; };
+};
+
+extern EEPROMClass EEPROM;
+
+#endif /* ifndef EEPROM_H */
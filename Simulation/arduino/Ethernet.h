@@ -0,0 +1,26 @@
+#ifndef ETHERNET_H
+#define ETHERNET_H
+
+/*  Host simulation of the Ethernet library
+
+    The host network is always up, the
+    PubSubClient simulation opens its own socket.
+*/
+
+#include "Arduino.h"
+
+class Client {
+public:
+    virtual ~Client(){};
+};
+
+class EthernetClient : public Client {};
+
+class EthernetClass {
+public:
+    int begin(uint8_t *mac) { return 1; };
+};
+
+extern EthernetClass Ethernet;
+
+#endif /* ifndef ETHERNET_H */
@@ -0,0 +1,253 @@
+#include "PubSubClient.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define MQTTCONNECT 0x10
+#define MQTTCONNACK 0x20
+#define MQTTPUBLISH 0x30
+#define MQTTSUBSCRIBE 0x82
+#define MQTTPINGREQ 0xC0
+
+// Receive window, the size of a W5100 socket buffer
+#define MQTT_RX_BUFFER 2048
+
+PubSubClient::PubSubClient(Client &client) {
+    in_capacity = MQTT_RX_BUFFER;
+    in_buffer = new uint8_t[in_capacity];
+    strcpy(host, "127.0.0.1");
+}
+
+PubSubClient::~PubSubClient() {
+    disconnectSocket();
+    delete[] in_buffer;
+}
+
+/*
+    Broker address, overridden by OELC_MQTT_HOST and OELC_MQTT_PORT
+*/
+PubSubClient &PubSubClient::setServer(uint8_t *ip, uint16_t port) {
+    const char *env_host = getenv("OELC_MQTT_HOST");
+    const char *env_port = getenv("OELC_MQTT_PORT");
+    snprintf(host, sizeof(host), "%s", env_host ? env_host : "127.0.0.1");
+    this->port = env_port ? atoi(env_port) : port;
+    return *this;
+}
+
+PubSubClient &PubSubClient::setCallback(MQTT_CALLBACK_SIGNATURE) {
+    this->callback = callback;
+    return *this;
+}
+
+/*
+    Send fixed header, remaining length and body
+*/
+bool PubSubClient::writePacket(uint8_t header, const uint8_t *body, size_t length) {
+    if (socket_fd < 0) return false;
+    uint8_t packet[5 + MQTT_MAX_PACKET_SIZE];
+    size_t pos = 0;
+    packet[pos++] = header;
+    size_t remaining = length;
+    do {
+        uint8_t digit = remaining % 128;
+        remaining /= 128;
+        if (remaining > 0) digit |= 0x80;
+        packet[pos++] = digit;
+    } while (remaining > 0);
+    if (pos + length > sizeof(packet)) return false;
+    memcpy(packet + pos, body, length);
+    pos += length;
+
+    size_t sent = 0;
+    while (sent < pos) {
+        ssize_t n = send(socket_fd, packet + sent, pos - sent, MSG_NOSIGNAL);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            usleep(100);
+            continue;
+        }
+        if (n <= 0) {
+            disconnectSocket();
+            return false;
+        }
+        sent += n;
+    }
+    last_out_activity = millis();
+    return true;
+}
+
+/*
+    Fill the receive window from the socket
+*/
+bool PubSubClient::readSocket() {
+    if (socket_fd < 0) return false;
+    if (in_length >= in_capacity) return true;
+    ssize_t n = recv(socket_fd, in_buffer + in_length, in_capacity - in_length, 0);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        disconnectSocket();
+        return false;
+    }
+    if (n > 0) in_length += n;
+    return true;
+}
+
+/*
+    True if a whole packet is in the receive window,
+    sets its header, body length and body offset
+*/
+bool PubSubClient::readPacket(uint8_t *header, size_t *length, size_t *offset) {
+    if (in_length < 2) return false;
+    size_t pos = 1;
+    size_t value = 0;
+    size_t multiplier = 1;
+    uint8_t digit;
+    do {
+        if (pos >= in_length) return false;
+        digit = in_buffer[pos++];
+        value += (digit & 0x7F) * multiplier;
+        multiplier *= 128;
+    } while (digit & 0x80);
+    if (pos + value > in_length) {
+        // packet can never fit, drop the window
+        if (pos + value > in_capacity) {
+            discarded++;
+            in_length = 0;
+        }
+        return false;
+    }
+    *header = in_buffer[0];
+    *length = value;
+    *offset = pos;
+    return true;
+}
+
+void PubSubClient::disconnectSocket() {
+    if (socket_fd >= 0) close(socket_fd);
+    socket_fd = -1;
+    in_length = 0;
+}
+
+bool PubSubClient::connect(const char *id) {
+    disconnectSocket();
+
+    char port_string[8];
+    snprintf(port_string, sizeof(port_string), "%u", port);
+    struct addrinfo hints = {};
+    struct addrinfo *address;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, port_string, &hints, &address) != 0) return false;
+    socket_fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    if (socket_fd < 0 || ::connect(socket_fd, address->ai_addr, address->ai_addrlen) != 0) {
+        freeaddrinfo(address);
+        disconnectSocket();
+        return false;
+    }
+    freeaddrinfo(address);
+
+    uint8_t body[MQTT_MAX_PACKET_SIZE];
+    size_t id_length = strlen(id);
+    const uint8_t variable_header[] = {0, 4, 'M', 'Q', 'T', 'T', 4, 0x02, 0, MQTT_KEEPALIVE};
+    memcpy(body, variable_header, sizeof(variable_header));
+    size_t pos = sizeof(variable_header);
+    body[pos++] = id_length >> 8;
+    body[pos++] = id_length & 0xFF;
+    memcpy(body + pos, id, id_length);
+    pos += id_length;
+    if (!writePacket(MQTTCONNECT, body, pos)) return false;
+
+    // wait for CONNACK
+    unsigned long start = millis();
+    uint8_t header;
+    size_t length, offset;
+    while (!readPacket(&header, &length, &offset)) {
+        if (!readSocket() || millis() - start > 5000) {
+            disconnectSocket();
+            return false;
+        }
+    }
+    bool accepted = (header & 0xF0) == MQTTCONNACK && length >= 2 && in_buffer[offset + 1] == 0;
+    in_length -= offset + length;
+    memmove(in_buffer, in_buffer + offset + length, in_length);
+    if (!accepted) {
+        disconnectSocket();
+        return false;
+    }
+    fcntl(socket_fd, F_SETFL, fcntl(socket_fd, F_GETFL) | O_NONBLOCK);
+    return true;
+}
+
+void PubSubClient::disconnect() {
+    const uint8_t none = 0;
+    writePacket(0xE0, &none, 0);
+    disconnectSocket();
+}
+
+bool PubSubClient::connected() {
+    return socket_fd >= 0;
+}
+
+bool PubSubClient::subscribe(const char *topic) {
+    uint8_t body[MQTT_MAX_PACKET_SIZE];
+    size_t topic_length = strlen(topic);
+    if (topic_length + 5 > sizeof(body)) return false;
+    size_t pos = 0;
+    body[pos++] = next_packet_id >> 8;
+    body[pos++] = next_packet_id & 0xFF;
+    next_packet_id++;
+    body[pos++] = topic_length >> 8;
+    body[pos++] = topic_length & 0xFF;
+    memcpy(body + pos, topic, topic_length);
+    pos += topic_length;
+    body[pos++] = 0; // QoS 0
+    return writePacket(MQTTSUBSCRIBE, body, pos);
+}
+
+bool PubSubClient::publish(const char *topic, const char *payload) {
+    return publish(topic, (const uint8_t*)payload, strlen(payload));
+}
+
+bool PubSubClient::publish(const char *topic, const uint8_t *payload, unsigned int length) {
+    uint8_t body[MQTT_MAX_PACKET_SIZE];
+    size_t topic_length = strlen(topic);
+    if (topic_length + length + 2 > sizeof(body)) return false;
+    body[0] = topic_length >> 8;
+    body[1] = topic_length & 0xFF;
+    memcpy(body + 2, topic, topic_length);
+    memcpy(body + 2 + topic_length, payload, length);
+    return writePacket(MQTTPUBLISH, body, 2 + topic_length + length);
+}
+
+/*
+    Keepalive and at most one incoming packet
+*/
+bool PubSubClient::loop() {
+    if (!readSocket()) return false;
+    if (millis() - last_out_activity > MQTT_KEEPALIVE * 1000UL) {
+        const uint8_t none = 0;
+        writePacket(MQTTPINGREQ, &none, 0);
+    }
+
+    uint8_t header;
+    size_t length, offset;
+    if (!readPacket(&header, &length, &offset)) return true;
+    if (offset + length > MQTT_MAX_PACKET_SIZE) {
+        discarded++;
+    } else if ((header & 0xF0) == MQTTPUBLISH && callback) {
+        memcpy(buffer, in_buffer + offset, length);
+        size_t topic_length = (buffer[0] << 8) | buffer[1];
+        size_t payload_start = 2 + topic_length + ((header & 0x06) ? 2 : 0);
+        if (payload_start <= length) {
+            // move topic down to null terminate it, as the library does
+            memmove(buffer, buffer + 2, topic_length);
+            buffer[topic_length] = 0;
+            callback((char*)buffer, buffer + payload_start, length - payload_start);
+        }
+    }
+    in_length -= offset + length;
+    memmove(in_buffer, in_buffer + offset + length, in_length);
+    return true;
+}
@@ -0,0 +1,58 @@
+#ifndef PUBSUBCLIENT_H
+#define PUBSUBCLIENT_H
+
+/*  Host simulation of PubSubClient
+
+    MQTT 3.1.1 QoS 0 client over a host TCP socket
+    with the PubSubClient API used by the gateway.
+
+    The broker address given to setServer() is
+    replaced by OELC_MQTT_HOST/OELC_MQTT_PORT when
+    they are set (default 127.0.0.1).
+
+    Like the library, loop() handles at most one
+    incoming packet per call, and packets larger than
+    MQTT_MAX_PACKET_SIZE are discarded.
+*/
+
+#include "Arduino.h"
+#include "Ethernet.h"
+
+#define MQTT_MAX_PACKET_SIZE 256
+#define MQTT_KEEPALIVE 15
+
+#define MQTT_CALLBACK_SIGNATURE void (*callback)(char*, uint8_t*, unsigned int)
+
+class PubSubClient {
+private:
+    int socket_fd = -1;
+    uint8_t buffer[MQTT_MAX_PACKET_SIZE];
+    uint8_t *in_buffer;
+    size_t in_length = 0;
+    size_t in_capacity;
+    uint16_t next_packet_id = 1;
+    unsigned long last_out_activity = 0;
+    char host[64];
+    uint16_t port = 1883;
+    MQTT_CALLBACK_SIGNATURE = NULL;
+    unsigned long discarded = 0;
+    bool writePacket(uint8_t header, const uint8_t *body, size_t length);
+    bool readSocket();
+    bool readPacket(uint8_t *header, size_t *length, size_t *offset);
+    void disconnectSocket();
+public:
+    PubSubClient(Client &client);
+    ~PubSubClient();
+    PubSubClient &setServer(uint8_t *ip, uint16_t port);
+    PubSubClient &setCallback(MQTT_CALLBACK_SIGNATURE);
+    bool connect(const char *id);
+    void disconnect();
+    bool connected();
+    bool subscribe(const char *topic);
+    bool publish(const char *topic, const char *payload);
+    bool publish(const char *topic, const uint8_t *payload, unsigned int length);
+    bool loop();
+    unsigned long discardedPackets() { return discarded; };
+};
+
+#endif /* ifndef PUBSUBCLIENT_H */
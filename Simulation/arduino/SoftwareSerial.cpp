@@ -0,0 +1,82 @@
+#include "SoftwareSerial.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+/*
+    Opens the pipes, O_RDWR so opening a fifo never blocks
+*/
+void SoftwareSerial::begin(long speed) {
+    baud = speed;
+    const char *in_path = getenv("OELC_UART_IN");
+    const char *out_paths = getenv("OELC_UART_OUT");
+    if (in_path) in_fd = open(in_path, O_RDWR | O_NONBLOCK);
+    while (out_paths && *out_paths && out_count < MAX_BUS_OUTPUTS) {
+        const char *end = strchr(out_paths, ':');
+        size_t length = end ? (size_t)(end - out_paths) : strlen(out_paths);
+        char path[256];
+        snprintf(path, sizeof(path), "%.*s", (int)length, out_paths);
+        int fd = open(path, O_RDWR);
+        if (fd >= 0) out_fds[out_count++] = fd;
+        out_paths = end ? end + 1 : out_paths + length;
+    }
+}
+
+/*
+    Move bytes waiting in the pipe into the rx buffer,
+    dropping what doesn't fit
+*/
+void SoftwareSerial::receive() {
+    if (in_fd < 0) return;
+    uint8_t c;
+    while (::read(in_fd, &c, 1) == 1) {
+        uint8_t next = (tail + 1) % _SS_MAX_RX_BUFF;
+        if (next == head) {
+            buffer_overflow = true;
+            continue;
+        }
+        buffer[tail] = c;
+        tail = next;
+    }
+}
+
+/*
+    True if bytes were dropped since last call
+*/
+bool SoftwareSerial::overflow() {
+    bool ret = buffer_overflow;
+    buffer_overflow = false;
+    return ret;
+}
+
+int SoftwareSerial::available() {
+    receive();
+    return (tail + _SS_MAX_RX_BUFF - head) % _SS_MAX_RX_BUFF;
+}
+
+int SoftwareSerial::read() {
+    int c = peek();
+    if (c >= 0) head = (head + 1) % _SS_MAX_RX_BUFF;
+    return c;
+}
+
+int SoftwareSerial::peek() {
+    if (head == tail) receive();
+    if (head == tail) return -1;
+    return buffer[head];
+}
+
+size_t SoftwareSerial::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+/*
+    Blocks for 10 bits per byte, as the bit-banged transmit does
+*/
+size_t SoftwareSerial::write(const uint8_t *buffer, size_t size) {
+    delayMicroseconds(size * 10000000UL / baud);
+    for (int i = 0; i < out_count; i++) {
+        if (::write(out_fds[i], buffer, size) < 0) return 0;
+    }
+    return size;
+}
@@ -0,0 +1,49 @@
+#ifndef SOFTWARESERIAL_H
+#define SOFTWARESERIAL_H
+
+/*  Host simulation of SoftwareSerial
+
+    The link is a pair of pipes, read from
+    OELC_UART_IN and written to OELC_UART_OUT.
+    Without them the port is disconnected,
+    writes are discarded and nothing is received.
+    OELC_UART_OUT can list several pipes separated
+    by ':', a bus where every byte goes to each of
+    them. Several writers can share one input pipe,
+    writes of a frame are not interleaved.
+
+    Like the AVR library, received bytes go into
+    a 64 byte buffer and are dropped (overflow())
+    when it is full, and write() blocks for the
+    time the bytes take on the wire.
+*/
+
+#include "Arduino.h"
+
+#define _SS_MAX_RX_BUFF 64
+#define MAX_BUS_OUTPUTS 32
+
+class SoftwareSerial : public Stream {
+private:
+    int in_fd = -1;
+    int out_fds[MAX_BUS_OUTPUTS];
+    int out_count = 0;
+    long baud = 9600;
+    uint8_t buffer[_SS_MAX_RX_BUFF];
+    uint8_t head = 0;
+    uint8_t tail = 0;
+    bool buffer_overflow = false;
+    void receive();
+public:
+    SoftwareSerial(uint8_t rx, uint8_t tx){};
+    void begin(long speed);
+    bool overflow();
+    virtual int available();
+    virtual int read();
+    virtual int peek();
+    virtual size_t write(uint8_t c);
+    virtual size_t write(const uint8_t *buffer, size_t size);
+    using Print::write;
+};
+
+#endif /* ifndef SOFTWARESERIAL_H */
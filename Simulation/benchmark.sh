@@ -0,0 +1,17 @@
+#!/bin/sh
+# Release benchmark: starts the host simulation against a broker,
+# runs the load test over a sweep of rates and stops the simulation.
+# Extra arguments are passed to loadtest.py.
+#
+# usage: Simulation/benchmark.sh [loadtest.py arguments]
+# OELC_MQTT_HOST/OELC_MQTT_PORT select the broker (127.0.0.1:1883)
+
+SIM=$(cd "$(dirname "$0")" && pwd)
+HOST=${OELC_MQTT_HOST:-127.0.0.1}
+PORT=${OELC_MQTT_PORT:-1883}
+
+"$SIM/run.sh" "$HOST" "$PORT" &
+RUN=$!
+trap 'kill $RUN 2> /dev/null' INT TERM EXIT
+
+python3 "$SIM/loadtest.py" --broker "$HOST" --port "$PORT" "$@"
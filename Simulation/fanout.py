@@ -0,0 +1,99 @@
+#!/usr/bin/env python
+# Multi-controller fan-out test
+#
+# For each device count, starts Simulation/multinode.sh with that many
+# controllers on the gateway's UART bus, publishes color updates to
+# LED/<id>/<channel> at a fixed rate per device and matches them against
+# each controller's PWM log (see loadtest.py for the delivered, coalesced,
+# dropped and corrupt counts). Shows how the delivery rate holds up as
+# the bus is shared by more devices.
+#
+# usage: python3 fanout.py --devices 1,2,4,8 [--rate 20] [--duration 5]
+import argparse
+import os
+import signal
+import subprocess
+import time
+import loadtest
+
+SIM = os.path.dirname(os.path.abspath(__file__))
+
+def pwmLog(device):
+    return os.path.join(SIM, "build", "pwm_%d.log" % device)
+
+def startNodes(count, broker, port, build):
+    env = dict(os.environ)
+    if not build:
+        env["OELC_SKIP_BUILD"] = "1"
+    return subprocess.Popen([os.path.join(SIM, "multinode.sh"), str(count), broker, str(port)],
+        env=env, stdout=subprocess.DEVNULL, start_new_session=True)
+
+def stopNodes(process):
+    os.killpg(process.pid, signal.SIGTERM)
+    process.wait()
+
+def waitForDevices(client, count, timeout):
+    # probe with broadcasts until every controller has shown one
+    start = time.time()
+    probe = loadtest.Channel("R", "LED/all/R")
+    seen = set()
+    while time.time() - start < timeout and len(seen) < count:
+        offsets = {d: os.path.getsize(pwmLog(d)) if os.path.exists(pwmLog(d)) else 0 for d in range(1, count + 1)}
+        client.publish(probe.topic, str(probe.next()))
+        time.sleep(0.5)
+        for device in range(1, count + 1):
+            if os.path.exists(pwmLog(device)) and \
+                    len(loadtest.readPWMLog(pwmLog(device), offsets[device]).get(loadtest.CHANNEL_PINS["R"], [])) > 0:
+                seen.add(device)
+    return len(seen) == count
+
+def run(client, count, rate, duration, settle, channel_names):
+    channels = [(device, loadtest.Channel(name, "LED/%d/%s" % (device, name)))
+                for device in range(1, count + 1) for name in channel_names]
+    offsets = {d: os.path.getsize(pwmLog(d)) for d in range(1, count + 1)}
+    sent, elapsed = loadtest.publishLoad(client, [channel for device, channel in channels], rate * count, 1, duration)
+    time.sleep(settle)
+    changes = {d: loadtest.readPWMLog(pwmLog(d), offsets[d]) for d in range(1, count + 1)}
+
+    total = {"delivered": 0, "coalesced": 0, "dropped": 0, "corrupt": 0, "latency": []}
+    for device, channel in channels:
+        result = loadtest.match(channel, changes[device].get(loadtest.CHANNEL_PINS[channel.name], []))
+        for key in total:
+            total[key] += result[key]
+    latency = sorted(total["latency"])
+    print("%7d %8.0f %11.0f %10.1f %9d %7d %7d %8.1f %8.1f %8.1f" % (count, sent / elapsed,
+        total["delivered"] / elapsed, 100.0 * total["delivered"] / max(1, sent),
+        total["coalesced"], total["dropped"], total["corrupt"],
+        loadtest.percentile(latency, 0.5) * 1e3, loadtest.percentile(latency, 0.9) * 1e3,
+        loadtest.percentile(latency, 0.99) * 1e3))
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Gateway fan-out to several controllers")
+    parser.add_argument("--broker", default=os.environ.get("OELC_MQTT_HOST", "127.0.0.1"))
+    parser.add_argument("--port", type=int, default=int(os.environ.get("OELC_MQTT_PORT", "1883")))
+    parser.add_argument("--devices", default="1,2,4,8", help="comma separated controller counts")
+    parser.add_argument("--rate", type=float, default=20.0, help="updates per second per device")
+    parser.add_argument("--duration", type=float, default=5.0, help="seconds per device count")
+    parser.add_argument("--settle", type=float, default=2.0, help="seconds to wait for the tail")
+    parser.add_argument("--channels", default="RGB", help="subset of RGB")
+    args = parser.parse_args()
+
+    client = loadtest.newClient("fanout_generator")
+    client.connect(args.broker, args.port)
+    client.loop_start()
+
+    print("%7s %8s %11s %10s %9s %7s %7s %8s %8s %8s" % ("devices", "sent/s", "delivered/s",
+        "delivered%", "coalesced", "dropped", "corrupt", "p50 ms", "p90 ms", "p99 ms"))
+    build = True
+    for count in [int(n) for n in args.devices.split(",")]:
+        nodes = startNodes(count, args.broker, args.port, build)
+        build = False
+        try:
+            if not waitForDevices(client, count, 60):
+                print("%7d controllers not responding, see Simulation/build/*.log" % count)
+                continue
+            run(client, count, args.rate, args.duration, args.settle, args.channels)
+        finally:
+            stopNodes(nodes)
+    client.loop_stop()
+    client.disconnect()
@@ -0,0 +1,187 @@
+#!/usr/bin/env python
+# MQTT -> gateway -> controller load test
+#
+# Publishes color updates to the broker at a given rate and burst size
+# and matches them against the LED changes in the simulation's PWM log
+# (see run.sh). Every channel gets a value sequence (1 <=> 255) where
+# consecutive values differ, so each update is either:
+#   delivered  its value reached the LED, in order
+#   coalesced  skipped, but a later update on the channel reached the LED
+#   dropped    nothing after it on the channel reached the LED
+# LED changes matching no update are counted as corrupt (UART misframing).
+# Latency is publish -> PWM write for delivered updates.
+# Sequences start from the run's start time, so a value left on the LED
+# by an earlier run is unlikely to match the first updates.
+#
+# --mode selects the topics exercised on the gateway:
+#   channel  one message per channel update on LED/R, G and B
+#   rgb      one LED/RGB "r,g,b" message updating all three channels
+#   frame    one binary LED/frame record {address, 7, r, g, b} per update
+# in rgb and frame mode the rate is messages per second, sent counts
+# channel updates.
+#
+# usage: python3 loadtest.py --rates 50,100,200 [--burst 1] [--duration 5] [--mode channel]
+import argparse
+import os
+import sys
+import time
+
+SIM = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, os.path.join(os.path.dirname(SIM), "RFID_Publisher"))
+from mqttclient import newClient
+
+CHANNEL_PINS = {"R": 11, "G": 10, "B": 9}
+MATCH_WINDOW = 512
+
+def readPWMLog(filename, offset):
+    changes = {}
+    with open(filename) as file:
+        file.seek(offset)
+        for line in file:
+            fields = line.split()
+            if len(fields) == 3:
+                changes.setdefault(int(fields[1]), []).append((float(fields[0]), int(fields[2])))
+    return changes
+
+MODES = ("channel", "rgb", "frame")
+
+class Channel:
+    def __init__(self, name, topic):
+        self.name = name
+        self.topic = topic
+        # start the sequence from the time, the LED may show a value from an earlier run
+        self.value = int(time.time() * 1000 + "RGB".find(name) * 85) % 255
+        self.published = []
+
+    def next(self):
+        self.value = self.value % 255 + 1
+        return self.value
+
+def publishUpdate(client, channels, count, mode, address):
+    # publish the count'th update, in rgb and frame mode one for all channels (R, G, B)
+    if mode == "channel":
+        channel = channels[count % len(channels)]
+        value = channel.next()
+        channel.published.append((time.time(), value))
+        client.publish(channel.topic, str(value))
+        return
+    values = [channel.next() for channel in channels]
+    now = time.time()
+    for channel, value in zip(channels, values):
+        channel.published.append((now, value))
+    if mode == "rgb":
+        client.publish(channels[0].topic, "%d,%d,%d" % tuple(values))
+    else:
+        client.publish(channels[0].topic, bytes([address, 7] + values))
+
+def publishLoad(client, channels, rate, burst, duration, mode="channel", address=0):
+    # bursts of `burst` back to back updates, rate is messages per second
+    period = burst / float(rate)
+    start = time.perf_counter()
+    deadline = start
+    count = 0
+    while time.perf_counter() - start < duration:
+        for i in range(burst):
+            publishUpdate(client, channels, count, mode, address)
+            count += 1
+        deadline += period
+        delay = deadline - time.perf_counter()
+        if delay > 0:
+            time.sleep(delay)
+    return count, time.perf_counter() - start
+
+def match(channel, changes):
+    # greedy in order match of LED changes (255 - value) to published updates
+    result = {"delivered": 0, "coalesced": 0, "dropped": 0, "corrupt": 0, "latency": []}
+    shown = [False] * len(channel.published)
+    i = 0
+    for t, pwm in changes:
+        j = i
+        while j < min(len(channel.published), i + MATCH_WINDOW) and 255 - channel.published[j][1] != pwm:
+            j += 1
+        if j < len(channel.published) and j < i + MATCH_WINDOW:
+            shown[j] = True
+            result["latency"].append(t - channel.published[j][0])
+            i = j + 1
+        else:
+            result["corrupt"] += 1
+    last_shown = max([k for k in range(len(shown)) if shown[k]], default=-1)
+    for k in range(len(shown)):
+        if shown[k]:
+            result["delivered"] += 1
+        elif k < last_shown:
+            result["coalesced"] += 1
+        else:
+            result["dropped"] += 1
+    return result
+
+def percentile(samples, p):
+    return samples[min(len(samples) - 1, int(len(samples) * p))] if samples else 0.0
+
+def waitForController(client, pwm_log, timeout):
+    # probe until an update comes through, the gateway waits after connecting
+    start = time.time()
+    probe = Channel("R", "LED/R")
+    while time.time() - start < timeout:
+        offset = os.path.getsize(pwm_log) if os.path.exists(pwm_log) else 0
+        client.publish(probe.topic, str(probe.next()))
+        time.sleep(0.5)
+        if os.path.exists(pwm_log) and len(readPWMLog(pwm_log, offset).get(CHANNEL_PINS["R"], [])) > 0:
+            return True
+    return False
+
+def run(client, topics, rate, burst, duration, pwm_log, settle, mode="channel", address=0):
+    channels = [Channel(name, topic) for name, topic in topics]
+    offset = os.path.getsize(pwm_log)
+    count, elapsed = publishLoad(client, channels, rate, burst, duration, mode, address)
+    time.sleep(settle)
+    changes = readPWMLog(pwm_log, offset)
+
+    total = {"delivered": 0, "coalesced": 0, "dropped": 0, "corrupt": 0, "latency": []}
+    for channel in channels:
+        result = match(channel, changes.get(CHANNEL_PINS[channel.name], []))
+        for key in total:
+            total[key] += result[key]
+    latency = sorted(total["latency"])
+    sent = sum(len(channel.published) for channel in channels)
+    print("%8.0f %6d %6d %9d %9d %7d %7d %8.1f %8.1f %8.1f" % (count / elapsed, burst, sent,
+        total["delivered"], total["coalesced"], total["dropped"], total["corrupt"],
+        percentile(latency, 0.5) * 1e3, percentile(latency, 0.9) * 1e3, percentile(latency, 0.99) * 1e3))
+    return total
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Gateway and controller throughput and loss test")
+    parser.add_argument("--broker", default="localhost")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--rates", default="10,50,100,200,500", help="comma separated updates per second")
+    parser.add_argument("--burst", type=int, default=1, help="updates sent back to back")
+    parser.add_argument("--duration", type=float, default=5.0, help="seconds per rate")
+    parser.add_argument("--settle", type=float, default=2.0, help="seconds to wait for the tail")
+    parser.add_argument("--channels", default="RGB", help="subset of RGB")
+    parser.add_argument("--mode", default="channel", choices=MODES, help="LED/<channel>, LED/RGB or LED/frame")
+    parser.add_argument("--topic", default=None, help="topic pattern, %%s is the channel in channel mode "
+        "(LED/%%s, LED/RGB, LED/frame)")
+    parser.add_argument("--address", type=int, default=0, help="frame mode record address")
+    parser.add_argument("--pwm-log", default=os.path.join(SIM, "build", "pwm.log"))
+    args = parser.parse_args()
+
+    client = newClient("load_generator")
+    client.connect(args.broker, args.port)
+    client.loop_start()
+    if not waitForController(client, args.pwm_log, 30):
+        print("No LED changes in " + args.pwm_log + ", is Simulation/run.sh running?")
+        exit(1)
+
+    if args.mode == "channel":
+        topics = [(name, (args.topic or "LED/%s") % name) for name in args.channels]
+    elif args.channels != "RGB":
+        print("--mode " + args.mode + " updates all three channels, use --channels RGB")
+        exit(1)
+    else:
+        topics = [(name, args.topic or ("LED/RGB" if args.mode == "rgb" else "LED/frame")) for name in "RGB"]
+    print("%8s %6s %6s %9s %9s %7s %7s %8s %8s %8s" % ("rate/s", "burst", "sent",
+        "delivered", "coalesced", "dropped", "corrupt", "p50 ms", "p90 ms", "p99 ms"))
+    for rate in args.rates.split(","):
+        run(client, topics, float(rate), args.burst, args.duration, args.pwm_log, args.settle, args.mode, args.address)
+    client.loop_stop()
+    client.disconnect()
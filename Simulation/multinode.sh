@@ -0,0 +1,53 @@
+#!/bin/sh
+# Runs one ETOU_Gateway and N LED_Controllers on a shared UART bus:
+# every byte the gateway sends goes to all controllers and they
+# all write to the one pipe back to the gateway.
+#
+# Controller k gets bus address k and group k % 2, and is put in
+# the UART state with the pot at full scale. Its LED changes go to
+# build/pwm_<k>.log and its output to build/controller_<k>.log.
+# Set OELC_SKIP_BUILD=1 to reuse the binaries of an earlier run.
+# Stop with Ctrl-C.
+#
+# usage: Simulation/multinode.sh <controllers> [broker host] [broker port]
+
+set -e
+SIM=$(cd "$(dirname "$0")" && pwd)
+REPO=$(dirname "$SIM")
+BUILD=$SIM/build
+CXX=${CXX:-g++}
+NODES=${1:-4}
+
+mkdir -p "$BUILD"
+if [ -z "$OELC_SKIP_BUILD" ]; then
+    for SKETCH in ETOU_Gateway LED_Controller; do
+        $CXX -std=c++11 -O2 -I"$SIM/arduino" -include Arduino.h \
+            -x c++ "$REPO/$SKETCH/$SKETCH.ino" -x none "$SIM"/arduino/*.cpp \
+            -o "$BUILD/$SKETCH"
+    done
+fi
+
+rm -f "$BUILD"/bus_* "$BUILD"/pwm_*.log "$BUILD/to_gateway"
+mkfifo "$BUILD/to_gateway"
+
+export OELC_MQTT_HOST=${2:-127.0.0.1}
+export OELC_MQTT_PORT=${3:-1883}
+
+trap 'kill 0' INT TERM EXIT
+
+BUS=""
+for ID in $(seq 1 "$NODES"); do
+    mkfifo "$BUILD/bus_$ID"
+    BUS="$BUS${BUS:+:}$BUILD/bus_$ID"
+    # set the address, then three "ns" commands to the UART state
+    (printf 'id %d %d\nns\nns\nns\n' "$ID" $((1 << (ID % 2))); sleep 2147483647) | \
+        OELC_UART_IN="$BUILD/bus_$ID" OELC_UART_OUT="$BUILD/to_gateway" \
+        OELC_PWM_LOG="$BUILD/pwm_$ID.log" OELC_POT=${OELC_POT:-1024} \
+        "$BUILD/LED_Controller" > "$BUILD/controller_$ID.log" &
+done
+
+OELC_UART_IN="$BUILD/to_gateway" OELC_UART_OUT="$BUS" \
+    "$BUILD/ETOU_Gateway" < /dev/null > "$BUILD/gateway.log" &
+
+echo "Simulation running, $NODES controllers, broker $OELC_MQTT_HOST:$OELC_MQTT_PORT"
+wait
@@ -0,0 +1,45 @@
+#!/bin/sh
+# Builds the ETOU_Gateway and LED_Controller sketches for the host
+# and runs them against a local MQTT broker (mosquitto), linked by
+# a pair of fifos in place of the SoftwareSerial wires.
+#
+# The controller is switched to the UART state on start, with the
+# pot at full scale (OELC_POT=1024, brightness 255) so LED values
+# show up unscaled in the PWM log.
+# Output goes to build/gateway.log, build/controller.log and
+# LED changes to build/pwm.log. Stop with Ctrl-C.
+#
+# usage: Simulation/run.sh [broker host] [broker port]
+
+set -e
+SIM=$(cd "$(dirname "$0")" && pwd)
+REPO=$(dirname "$SIM")
+BUILD=$SIM/build
+CXX=${CXX:-g++}
+
+mkdir -p "$BUILD"
+for SKETCH in ETOU_Gateway LED_Controller; do
+    $CXX -std=c++11 -O2 -I"$SIM/arduino" -include Arduino.h \
+        -x c++ "$REPO/$SKETCH/$SKETCH.ino" -x none "$SIM"/arduino/*.cpp \
+        -o "$BUILD/$SKETCH"
+done
+
+rm -f "$BUILD/to_controller" "$BUILD/to_gateway" "$BUILD/pwm.log"
+mkfifo "$BUILD/to_controller" "$BUILD/to_gateway"
+
+export OELC_MQTT_HOST=${1:-127.0.0.1}
+export OELC_MQTT_PORT=${2:-1883}
+
+trap 'kill 0' INT TERM EXIT
+
+# three "ns" commands take the controller from RGB to the UART state
+(printf 'ns\nns\nns\n'; sleep 2147483647) | \
+    OELC_UART_IN="$BUILD/to_controller" OELC_UART_OUT="$BUILD/to_gateway" \
+    OELC_PWM_LOG="$BUILD/pwm.log" OELC_POT=${OELC_POT:-1024} \
+    "$BUILD/LED_Controller" > "$BUILD/controller.log" &
+
+OELC_UART_IN="$BUILD/to_gateway" OELC_UART_OUT="$BUILD/to_controller" \
+    "$BUILD/ETOU_Gateway" < /dev/null > "$BUILD/gateway.log" &
+
+echo "Simulation running, broker $OELC_MQTT_HOST:$OELC_MQTT_PORT"
+wait
@@ -0,0 +1,140 @@
+#!/usr/bin/env python
+# LED_Controller binary telemetry decoder
+#
+# Decodes the snapshot frames written by LED_Controller/telemetry.hpp
+# (enabled with the "tlm <ms>" serial command) from a serial port,
+# a capture file or stdin, skipping any text output in between.
+#
+# usage: python3 decoder.py /dev/ttyACM0 [--period 20] [--csv]
+#        python3 decoder.py capture.bin
+#        ... | python3 decoder.py -
+import argparse
+import struct
+import sys
+import time
+
+MAGIC = b"\xA5\x5A"
+TRACKS = 3
+SNAPSHOT = struct.Struct("<BBIBBBB4sB%dH%dIHHHH" % (TRACKS, TRACKS))
+VERSION = 3
+FIELDS = ["sequence", "time", "state", "param_1", "param_2", "selected_led",
+          "red", "green", "blue", "brightness"] + \
+         ["%s_%d" % (name, track) for track in range(TRACKS)
+          for name in ("running", "looping", "task", "task_elapsed")] + \
+         ["log_dropped", "command_errors", "uart_errors", "skipped"]
+
+def crc8(data):
+    crc = 0
+    for byte in data:
+        crc ^= byte
+        for i in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+# lookup table, one step per byte
+CRC_TABLE = [crc8(bytes([i])) for i in range(256)]
+
+def crc8Fast(data):
+    crc = 0
+    for byte in data:
+        crc = CRC_TABLE[crc ^ byte]
+    return crc
+
+class Decoder:
+    def __init__(self):
+        self.buffer = b""
+        self.frames = 0
+        self.crc_errors = 0
+        self.lost = 0
+        self.last_sequence = None
+
+    def feed(self, data):
+        # returns decoded snapshots, keeps incomplete frames for the next call
+        self.buffer += data
+        snapshots = []
+        frame_size = 3 + SNAPSHOT.size + 1
+        while True:
+            start = self.buffer.find(MAGIC)
+            if start < 0:
+                # keep a trailing first magic byte
+                self.buffer = self.buffer[-1:] if self.buffer.endswith(MAGIC[:1]) else b""
+                break
+            if len(self.buffer) - start < frame_size:
+                self.buffer = self.buffer[start:]
+                break
+            payload = self.buffer[start + 3:start + 3 + SNAPSHOT.size]
+            if self.buffer[start + 2] != SNAPSHOT.size or payload[0] != VERSION \
+                    or crc8Fast(payload) != self.buffer[start + frame_size - 1]:
+                self.crc_errors += 1
+                self.buffer = self.buffer[start + 1:]
+                continue
+            self.buffer = self.buffer[start + frame_size:]
+            snapshots.append(self.decode(payload))
+        return snapshots
+
+    def decode(self, payload):
+        values = SNAPSHOT.unpack(payload)
+        version, sequence, millis, state, p1, p2, led, rgbb, flags = values[:9]
+        tasks = values[9:9 + TRACKS]
+        elapsed = values[9 + TRACKS:9 + 2 * TRACKS]
+        log_dropped, command_errors, uart_errors, skipped = values[9 + 2 * TRACKS:]
+        if self.last_sequence is not None:
+            self.lost += (sequence - self.last_sequence - 1) & 0xFF
+        self.last_sequence = sequence
+        self.frames += 1
+        snapshot = {"sequence": sequence, "time": millis, "state": state, "param_1": p1, "param_2": p2,
+                    "selected_led": led, "red": rgbb[0], "green": rgbb[1], "blue": rgbb[2],
+                    "brightness": rgbb[3], "log_dropped": log_dropped,
+                    "command_errors": command_errors, "uart_errors": uart_errors, "skipped": skipped}
+        for track in range(TRACKS):
+            snapshot["running_%d" % track] = (flags >> track) & 1
+            snapshot["looping_%d" % track] = (flags >> (4 + track)) & 1
+            snapshot["task_%d" % track] = tasks[track]
+            snapshot["task_elapsed_%d" % track] = elapsed[track]
+        return snapshot
+
+def openSource(name, baud, period):
+    if name == "-":
+        return sys.stdin.buffer
+    if name.startswith("/dev/") or name.upper().startswith("COM"):
+        import serial
+        port = serial.Serial(name, baud, timeout=0.1)
+        time.sleep(2) # UNO resets on open
+        if period is not None:
+            port.write(("tlm " + str(period) + "\n").encode())
+        return port
+    return open(name, "rb")
+
+def readChunk(source):
+    if hasattr(source, "in_waiting"):
+        return source.read(max(1, source.in_waiting))
+    return source.read1(4096) if hasattr(source, "read1") else source.read(4096)
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Decode LED_Controller telemetry")
+    parser.add_argument("source", help="serial port, capture file or - for stdin")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--period", type=int, help="send \"tlm <period>\" to the device first")
+    parser.add_argument("--csv", action="store_true")
+    args = parser.parse_args()
+
+    decoder = Decoder()
+    source = openSource(args.source, args.baud, args.period)
+    if args.csv:
+        print(",".join(FIELDS))
+    start = time.time()
+    try:
+        while True:
+            data = readChunk(source)
+            if not data and not hasattr(source, "in_waiting"):
+                break
+            for snapshot in decoder.feed(data):
+                if args.csv:
+                    print(",".join(str(snapshot[field]) for field in FIELDS))
+                else:
+                    print(" ".join("%s=%s" % (field, snapshot[field]) for field in FIELDS))
+    except KeyboardInterrupt:
+        pass
+    elapsed = time.time() - start
+    sys.stderr.write("frames %d, lost %d, bad %d, %.1f frames/s\n" % (decoder.frames,
+        decoder.lost, decoder.crc_errors, decoder.frames / elapsed if elapsed > 0 else 0))